@@ -17,37 +17,86 @@
  *----------------------------------------------------------------------------*/
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "auto_split.h"
-#include "abstract_lists.h"
-#include "sort.h"
 
 /* Transparent pixels are assumed to be set to zero */
 
+/* First column of a non-zero pixel in row between x and x1, or x1 */
+static int skip_empty (uint32_t *row, int x, int x1)
+{
+#ifdef __SSE2__
+	__m128i zero = _mm_setzero_si128();
+	__m128i t;
+
+	/* Skip empty pixels 16 at a time, then narrow down to 4 */
+	for (; x + 16 <= x1; x += 16)
+	{
+		t = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((__m128i *)(row + x)), _mm_loadu_si128((__m128i *)(row + x + 4))),
+			_mm_or_si128(_mm_loadu_si128((__m128i *)(row + x + 8)), _mm_loadu_si128((__m128i *)(row + x + 12))));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(t, zero)) != 0xffff)
+			break;
+	}
+	for (; x + 4 <= x1; x += 4)
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(row + x)), zero)) != 0xffff)
+			break;
+#endif
+	for (; x < x1 && !row[x]; x++);
+
+	return x;
+}
+
+/* First and last column of a non-zero pixel in row between x0 and x1, or -1 */
+static void scan_segment (uint32_t *row, int x0, int x1, int *first, int *last)
+{
+	int x, e = x1;
+#ifdef __SSE2__
+	__m128i zero = _mm_setzero_si128();
+#endif
+
+	if ((x = skip_empty(row, x0, x1)) == x1)
+	{
+		*first = -1;
+		*last = -1;
+		return;
+	}
+	*first = x;
+
+	/* row[x] is set, so the backward scan stops there at the latest */
+#ifdef __SSE2__
+	for (; e - 4 > x; e -= 4)
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(row + e - 4)), zero)) != 0xffff)
+			break;
+#endif
+	for (e--; !row[e]; e--);
+	*last = e;
+}
+
 void auto_crop (pic_t p, crop_t *c)
 {
-	uint32_t *b = (uint32_t *)p.b;
 	int min_x = INT_MAX, max_x = INT_MIN, min_y = INT_MAX, max_y = INT_MIN;
-	int seen_pixel = 0;
-	int x, y;
+	int x1 = MIN(c->x + c->w, p.w);
+	int first, last;
+	int y;
 
-	for (y = c->y; y < c->y + c->h && y < p.h; y++)
-		for (x = c->x; x < c->x + c->w && x < p.w; x++)
-			if (b[x + p.s * y])
-			{
-				seen_pixel = 1;
-				if (x < min_x)
-					min_x = x;
-				if (x > max_x)
-					max_x = x;
-				if (y < min_y)
-					min_y = y;
-				if (y > max_y)
-					max_y = y;
-			}
+	for (y = c->y; y < c->y + c->h && y < p.h && c->x < x1; y++)
+	{
+		scan_segment((uint32_t *)p.b + p.s * y, c->x, x1, &first, &last);
+		if (first < 0)
+			continue;
+		min_x = MIN(min_x, first);
+		max_x = MAX(max_x, last);
+		min_y = MIN(min_y, y);
+		max_y = y;
+	}
 
-	if (!seen_pixel)
+	if (min_y == INT_MAX)
 	{
 		c->w = 0;
 		c->h = 0;
@@ -60,7 +109,39 @@ void auto_crop (pic_t p, crop_t *c)
 		c->h = max_y - min_y + 1;
 	}
 
-	/* Ensure no forbidden/tiny results are produced */
+	enforce_min_size(p, c);
+}
+
+int crops_cover (pic_t p, crop_t area, crop_t *c, int n)
+{
+	uint32_t *row;
+	int x0 = MAX(0, area.x), x1 = MIN(area.x + area.w, p.w);
+	int x, y, k, e;
+
+	for (y = MAX(0, area.y); y < area.y + area.h && y < p.h && x0 < x1; y++)
+	{
+		row = (uint32_t *)p.b + p.s * y;
+		for (x = skip_empty(row, x0, x1); x < x1; x = skip_empty(row, e, x1))
+		{
+			/* Skip to the end of the crops containing the pixel */
+			e = x;
+			for (k = 0; k < n; k++)
+				if (y >= c[k].y && y < c[k].y + c[k].h && e >= c[k].x && e < c[k].x + c[k].w)
+				{
+					e = c[k].x + c[k].w;
+					k = -1;
+				}
+			if (e == x)
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Ensure no forbidden/tiny results are produced */
+void enforce_min_size (pic_t p, crop_t *c)
+{
 	if (c->w < 8)
 	{
 		if (c->x + 8 > p.w)
@@ -75,65 +156,123 @@ void auto_crop (pic_t p, crop_t *c)
 	}
 }
 
-static int block_state (pic_t p, crop_t c)
+/* Horizontal run of non-zero pixels, end is exclusive. Runs touching each
+ * other, diagonally included, are joined into trees with the lowest run as
+ * root, which becomes the connected component's index in comp. */
+typedef struct run_s
 {
-	uint32_t *b = (uint32_t *)p.b;
-	int x, y;
-
-	for (y = c.y; y < c.y + c.h && y < p.h; y++)
-		for (x = c.x; x < c.x + c.w && x < p.w; x++)
-			if (b[x + p.s * y])
-				return -1;
-
-	return 0;
-}
-
-#define GRID_BLOCKS 24 /* GCD of 480, 576, 720, 1080 */
-
-static int line_ok (int grid[GRID_BLOCKS + 1][GRID_BLOCKS + 1], int x, int y, int w)
+	int x;
+	int end;
+	int y;
+	int parent;
+	int comp;
+} run_t;
+
+static int find_root (run_t *runs, int i)
 {
-	int i;
-
-	if (grid[y][MAX(0, x - 1)] == -1)
-		return 0;
-
-	for (i = 0; i < w; i++)
-		if (grid[y][x + i] != -1)
-			return 0;
-
-	if (grid[y][MIN(GRID_BLOCKS, x + i)] == -1)
-		return 0;
+	while (runs[i].parent != i)
+		i = runs[i].parent = runs[runs[i].parent].parent;
 
-	return 1;
+	return i;
 }
 
-static void set_line (int grid[GRID_BLOCKS + 1][GRID_BLOCKS + 1], int x, int y, int w, int n)
+static void join_runs (run_t *runs, int a, int b)
 {
-	int i;
-
-	for (i = 0; i < w; i++)
-		grid[y][x + i] = n;
+	a = find_root(runs, a);
+	b = find_root(runs, b);
+	if (a < b)
+		runs[b].parent = a;
+	else
+		runs[a].parent = b;
 }
 
-static rect_t make_rect (int grid[GRID_BLOCKS + 1][GRID_BLOCKS + 1], int x, int y, int n)
+/* Bounding boxes of the 8-connected components of non-zero pixels inside of
+ * area. Returns their number, *comps is malloced and has to be freed. */
+static int find_components (pic_t p, crop_t area, rect_t **comps)
 {
-	rect_t r = {x, y, 1, 1};
-	int line_length = 1;
+	run_t *runs = NULL;
+	rect_t *boxes;
+	rect_t r;
+	uint32_t *row;
+	int n_runs = 0, size = 0;
+	int n_comp = 0;
+	int x0 = MAX(0, area.x), x1 = MIN(area.x + area.w, p.w);
+	int prev, row_start;
+	int x, e, y, i;
+
+	row_start = 0;
+	for (y = MAX(0, area.y); y < area.y + area.h && y < p.h && x0 < x1; y++)
+	{
+		row = (uint32_t *)p.b + p.s * y;
+		prev = row_start;
+		row_start = n_runs;
+		for (x = skip_empty(row, x0, x1); x < x1; x = skip_empty(row, e, x1))
+		{
+			for (e = x + 1; e < x1 && row[e]; e++);
+			if (n_runs == size)
+			{
+				size = MAX(256, size * 2);
+				if ((runs = realloc(runs, size * sizeof(run_t))) == NULL)
+				{
+					fprintf(stderr, "Error: Cannot allocate pixel runs.\n");
+					exit(1);
+				}
+			}
+			runs[n_runs].x = x;
+			runs[n_runs].end = e;
+			runs[n_runs].y = y;
+			runs[n_runs].parent = n_runs;
+
+			/* Join runs of the previous row from one left of x to one right of
+			 * the last pixel. The next run starts past e, so prev only moves on. */
+			while (prev < row_start && runs[prev].y == y - 1 && runs[prev].end < x)
+				prev++;
+			for (i = prev; i < row_start && runs[i].y == y - 1 && runs[i].x <= e; i++)
+				join_runs(runs, i, n_runs);
+			n_runs++;
+		}
+	}
 
-	/* Get length of first rectangle line, and assign rect number */
-	grid[y][x] = n;
-	while (line_length + x < GRID_BLOCKS + 1 && grid[y][x + line_length] == -1)
+	/* Roots come before their runs, so parents are final when reached */
+	boxes = malloc(MAX(1, n_runs) * sizeof(rect_t));
+	if (boxes == NULL)
 	{
-		grid[y][x + line_length] = n;
-		line_length++;
+		fprintf(stderr, "Error: Cannot allocate component list.\n");
+		exit(1);
+	}
+	for (i = 0; i < n_runs; i++)
+	{
+		r.x = runs[i].x;
+		r.y = runs[i].y;
+		r.w = runs[i].end - runs[i].x;
+		r.h = 1;
+		if (runs[i].parent == i)
+		{
+			runs[i].comp = n_comp;
+			boxes[n_comp++] = r;
+		}
+		else
+		{
+			runs[i].parent = runs[runs[i].parent].parent;
+			runs[i].comp = runs[runs[i].parent].comp;
+			boxes[runs[i].comp] = merge_rects(boxes[runs[i].comp], r);
+		}
 	}
-	r.w = line_length;
 
-	/* Add lines while available */
-	while (line_ok(grid, x, r.y + r.h, r.w))
-		set_line(grid, x, r.y + r.h++, r.w, n);
+	free(runs);
+	*comps = boxes;
+	return n_comp;
+}
 
-	return r;
+/* Turn a window into a crop that can be written */
+static void fit_window (pic_t p, crop_t *c, int even_y)
+{
+	enforce_min_size(p, c);
+	if (even_y && c->y % 2)
+	{
+		c->y--;
+		c->h++;
+	}
 }
 
 rect_t merge_rects (rect_t r1, rect_t r2)
@@ -195,160 +334,67 @@ static int check_close (rect_t r1, rect_t r2, int distance)
 	return 1;
 }
 
-/* crop_t *c - Array of length 2 */
+/* Splits the image into up to two windows of minimal total area, separated by
+ * a horizontal or vertical line, and covering all connected components.
+ * crop_t *c - Array of length 2, c[0] has to contain all non-zero pixels */
 int auto_split (pic_t p, crop_t *c, int ugly, int even_y)
 {
 	crop_t c1 = {0, 0, 0, 0};
 	crop_t c2 = {0, 0, 0, 0};
 	crop_t null = {0, 0, 0, 0};
-	crop_t t;
-	rect_t rects[(GRID_BLOCKS + 1) * (GRID_BLOCKS + 1)];
-	rect_t r1 = {0};
-	rect_t r2 = {0};
-	rect_t rt1, rt2;
-	int grid[GRID_BLOCKS + 1][GRID_BLOCKS + 1];
-	int score_t1, score_t2, score_r1 = 0, score_r2 = 0;
-	int n_rect = 0;
-	int score = 0;
-	int bw, bh;
-	int x, y;
-	int i, j;
+	rect_t windows[2];
+	rect_t *comps;
+	rect_t rt;
+	int score_t1, score_t2;
+	int n_comp;
 	int n_res;
 
-	/* Initialize grid */
-	memset(grid, 0, sizeof(int) * (GRID_BLOCKS + 1) * (GRID_BLOCKS + 1));
-	bw = p.w / GRID_BLOCKS;
-	bh = p.h / GRID_BLOCKS;
-
-	/* Ensure block height is even, if even_y is enabled */
-	if (even_y && (bh % 2))
-		bh--;
-
-	/* Ensure block dimensions are not zero */
-	if (!bw)
-		bw = 1;
-	if (!bh && even_y)
-		bh = 2;
-	else if (!bh)
-		bh = 1;
-
-	/* Determine state of blocks */
-	t.w = bw;
-	t.h = bh;
-	for (y = 0; (t.y = y * bh) < p.h; y++)
-		for (x = 0; (t.x = x * bw) < p.w; x++)
-			grid[y][x] = block_state(p, t);
-
-	/* Create rectangles */
-	for (y = 0; y < GRID_BLOCKS + 1; y++)
-		for (x = 0; x < GRID_BLOCKS + 1; x++)
-			if (grid[y][x] == -1)
-			{
-				rects[n_rect] = make_rect(grid, x, y, n_rect);
-				n_rect++;
-			}
+	n_comp = find_components(p, c[0], &comps);
+	n_res = find_windows(comps, n_comp, windows);
+	free(comps);
 
 	/* Shouldn't happen, empty frame */
-	if (!n_rect)
+	if (!n_res)
 	{
 		c[0] = c1;
 		c[1] = c2;
 		return 0;
 	}
 
-	/* Single rectangle */
-	if (n_rect == 1)
+	c1 = windows[0];
+	fit_window(p, &c1, even_y);
+	if (n_res == 1)
 	{
-		c1.x = rects[0].x * bw;
-		c1.y = rects[0].y * bh;
-		c1.w = rects[0].w * bw;
-		c1.h = rects[0].h * bh;
-		auto_crop(p, &c1);
 		c[0] = c1;
 		c[1] = c2;
 		return 1;
 	}
-
-	/* Two rectangles */
-	n_res = 2;
-
-	/* Any other number of rectangles, first find most "distant" ones */
-	for (i = 0; i < n_rect; i++)
-		for (j = 0; j < n_rect; j++)
-			if (i == j)
-				continue;
-			else
-			{
-				rt1 = merge_rects(rects[i], rects[j]);
-				score_t1 = score_rect(rt1);
-				if (score <= score_t1)
-				{
-					score = score_t1;
-					r1 = rects[i];
-					r2 = rects[j];
-					score_r1 = score_rect(r1);
-					score_r2 = score_rect(r2);
-				}
-			}
-
-	/* Merge all other rectangles with the "nearest" one */
-	for (i = 0; i < n_rect; i++)
-	{
-		rt1 = merge_rects(r1, rects[i]);
-		rt2 = merge_rects(r2, rects[i]);
-		score_t1 = score_rect(rt1);
-		score_t2 = score_rect(rt2);
-		if (score_t1 - score_r1 < score_t2 - score_r2)
-		{
-			r1 = rt1;
-			score_r1 = score_t1;
-		}
-		else
-		{
-			r2 = rt2;
-			score_r2 = score_t2;
-		}
-	}
-
-	/* Turn rectangles into crops */
-	c1.x = r1.x * bw;
-	c1.y = r1.y * bh;
-	c1.w = r1.w * bw;
-	c1.h = r1.h * bh;
-	c2.x = r2.x * bw;
-	c2.y = r2.y * bh;
-	c2.w = r2.w * bw;
-	c2.h = r2.h * bh;
-
-	/* Minimize surfaces and return them */
-	auto_crop(p, &c1);
-	auto_crop(p, &c2);
+	c2 = windows[1];
+	fit_window(p, &c2, even_y);
 
 	/* Merge in rare cases of closeness or overlap */
 	if ((!ugly && check_close(c1, c2, 0)) || (ugly && check_close(c1, c2, -1)))
-	{
-		c1 = merge_rects(c1, c2);
-		c2 = null;
-		auto_crop(p, &c1);
 		n_res = 1;
-	}
 	else if (!ugly)
 	{
 		/* Check whether split is ugly due to small gains */
-		rt1 = merge_rects(c1, c2);
-		score_t1 = score_rect(rt1);
+		rt = merge_rects(c1, c2);
+		score_t1 = score_rect(rt);
 		score_t2 = score_rect(c1) + score_rect(c2);
 
 		/* Merge if area taken by the merged rectangle is less than 1.5 * sum of
 		 * split rectangles and the difference is below a hard limit.
 		 */
 		if ((score_t1 < 3 * score_t2 / 2) && (score_t1 - score_t2 < 500 * 300))
-		{
-			c1 = merge_rects(c1, c2);
-			c2 = null;
-			auto_crop(p, &c1);
 			n_res = 1;
-		}
+	}
+
+	/* The windows are exact, so their union needs no further cropping */
+	if (n_res == 1)
+	{
+		c1 = merge_rects(windows[0], windows[1]);
+		c2 = null;
+		fit_window(p, &c1, even_y);
 	}
 
 	c[0] = c1;
@@ -356,64 +402,123 @@ int auto_split (pic_t p, crop_t *c, int ugly, int even_y)
 	return n_res;
 }
 
-/* Find two minimal non-overlapping windows covering the given rectangles. */
+/* Find two minimal non-overlapping windows covering the given rectangles.
+ * Two non-overlapping windows are always separated by a horizontal or vertical
+ * line, so for both directions, rectangles are sorted by their left/top edge,
+ * grouped where they overlap in that direction, and every split between two
+ * groups is tried. */
 
-typedef struct window_s
-{
-	rect_t r;  /* Position and size. */
-	int s;     /* Score. */
-} window_t;
+/* Up to this many rectangles, work memory is taken from the stack */
+#define WINDOW_STACK_RECTS 64
 
-typedef struct interval_s
+typedef struct window_work_s
 {
-	rect_t r;
-	int start, end;
-} interval_t;
-
-STATIC_LIST(interval, interval_t)
-
-int cmp_rect_x (rect_t *a, rect_t *b)
+	int *order;     /* Rectangle indices, sorted by left/top edge */
+	int *tmp;
+	rect_t *groups; /* Bounding boxes of overlapping rectangles */
+	rect_t *fwd;    /* Bounding box of groups 0 to i */
+	rect_t *bwd;    /* Bounding box of groups i + 1 to the last */
+} window_work_t;
+
+static inline int rect_start (rect_t *r, int dir)
 {
-	return a->x > b->x;
+	return dir ? r->y : r->x;
 }
 
-int cmp_rect_y (rect_t *a, rect_t *b)
+static inline int rect_size (rect_t *r, int dir)
 {
-	return a->y > b->y;
+	return dir ? r->h : r->w;
 }
 
-void rect_bounds_x (rect_t *c, int *x, int *w)
-{
-	*x = c->x;
-	*w = c->w;
-}
+/* Below this many rectangles, insertion sort is faster than radix sort */
+#define RADIX_SORT_RECTS 32
 
-void rect_bounds_y (rect_t *c, int *y, int *h)
+/* Stable sort of rectangle indices by left/top edge. Radix sort goes one byte
+ * at a time, skipping passes where all edges have the same byte. */
+static void sort_rects (rect_t *rects, int n, int dir, window_work_t *ww)
 {
-	*y = c->y;
-	*h = c->h;
+	int count[256];
+	int *from = ww->order, *to = ww->tmp, *t;
+	uint32_t key;
+	int shift, sum, c, start;
+	int i, j;
+
+	for (i = 0; i < n; i++)
+		from[i] = i;
+	if (n < RADIX_SORT_RECTS)
+	{
+		for (i = 1; i < n; i++)
+		{
+			c = from[i];
+			start = rect_start(&(rects[c]), dir);
+			for (j = i; j > 0 && rect_start(&(rects[from[j - 1]]), dir) > start; j--)
+				from[j] = from[j - 1];
+			from[j] = c;
+		}
+		return;
+	}
+	for (shift = 0; shift < 32; shift += 8)
+	{
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < n; i++)
+		{
+			key = (uint32_t)rect_start(&(rects[i]), dir) ^ 0x80000000u;
+			count[(key >> shift) & 0xff]++;
+		}
+		if (count[(((uint32_t)rect_start(&(rects[0]), dir) ^ 0x80000000u) >> shift) & 0xff] == n)
+			continue;
+		for (i = 0, sum = 0; i < 256; i++)
+		{
+			c = count[i];
+			count[i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++)
+		{
+			key = (uint32_t)rect_start(&(rects[from[i]]), dir) ^ 0x80000000u;
+			to[count[(key >> shift) & 0xff]++] = from[i];
+		}
+		t = from;
+		from = to;
+		to = t;
+	}
+	if (from != ww->order)
+		memcpy(ww->order, from, n * sizeof(int));
 }
 
 /* The windows argument must point to 2 * sizeof(rect_t) allocated memory. */
 int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 {
-	void (*rect_bounds)(rect_t *, int *, int *);
-	rect_t **sorted     = malloc(sizeof(void *) * n_rects);
-	void *work[2][2]    = { {rect_bounds_x, cmp_rect_x}
-	                      , {rect_bounds_y, cmp_rect_y}
-	                      };
-	interval_list_t *segs;
-	interval_t *iv = NULL;
-	window_t *fwd, *bwd;
-	rect_t best[2], tmp;
-	int i, dir, edge, a, b, n_ivs, found;
-	int score = -1;
+	int stack_ints[2 * WINDOW_STACK_RECTS];
+	rect_t stack_rects[3 * WINDOW_STACK_RECTS];
+	void *heap = NULL;
+	window_work_t ww;
+	rect_t best[2], tmp, *r;
+	int i, dir, edge, a, n_groups, found;
+	int score = -1, s;
 
 	if (!n_rects)
-	{
-		free(sorted);
 		return 0;
+
+	if (n_rects <= WINDOW_STACK_RECTS)
+	{
+		ww.order = stack_ints;
+		ww.groups = stack_rects;
 	}
+	else
+	{
+		heap = malloc(n_rects * (2 * sizeof(int) + 3 * sizeof(rect_t)));
+		if (heap == NULL)
+		{
+			fprintf(stderr, "Error: Cannot allocate window search memory.\n");
+			exit(1);
+		}
+		ww.groups = heap;
+		ww.order = (int *)(ww.groups + 3 * n_rects);
+	}
+	ww.tmp = ww.order + n_rects;
+	ww.fwd = ww.groups + n_rects;
+	ww.bwd = ww.fwd + n_rects;
 
 	memset(best, 0, 2 * sizeof(rect_t));
 	found = 0;
@@ -421,90 +526,45 @@ int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 	for (dir = 0; dir < 2; dir++)
 	{
 		/* Sort rectangles from left/top to right/bottom. */
-		for (i = 0; i < n_rects; i++)
-			sorted[i] = &(rects[i]);
-		sort((sort_func_t)work[dir][1], (void **)sorted, n_rects);
+		sort_rects(rects, n_rects, dir, &ww);
 
 		/* Group overlapping rectangles. */
-		segs  = interval_list_new();
-		n_ivs = 0;
-		edge  = -1;
-
-		rect_bounds = work[dir][0];
+		n_groups = 0;
+		edge = INT_MIN;
 		for (i = 0; i < n_rects; i++)
 		{
-			rect_bounds(sorted[i], &a, &b);
+			r = &(rects[ww.order[i]]);
+			a = rect_start(r, dir);
 			if (a < edge)
-			{
-				iv->end = MAX(iv->end, a + b);
-				iv->r   = merge_rects(iv->r, *(sorted[i]));
-				edge    = iv->end;
-			}
+				ww.groups[n_groups - 1] = merge_rects(ww.groups[n_groups - 1], *r);
 			else
-			{
-				iv = malloc(sizeof(interval_t));
-				iv->start = a;
-				iv->end   = a + b;
-				iv->r     = *(sorted[i]);
-				interval_list_insert_after(segs, iv);
-				n_ivs++;
-				edge = iv->end;
-			}
-		}
-
-		if (!n_ivs)
-		{
-			interval_list_destroy_deep(segs);
-			continue;
-		}
-
-		/* Sum up scores for interval 0-n and vice versa. */
-		fwd = malloc(sizeof(window_t) * n_ivs);
-		bwd = malloc(sizeof(window_t) * n_ivs);
-
-		iv = interval_list_first(segs);
-		/* Initialize first candidate. */
-		fwd[0].r = iv->r;
-		fwd[0].s = score_rect(fwd[0].r);
-		/* Merge/sum up the rest. */
-		for (i = 1; i < n_ivs && iv != NULL; i++)
-		{
-			iv = interval_list_next(segs);
-			fwd[i].r = merge_rects(fwd[i - 1].r, iv->r);
-			fwd[i].s = score_rect(fwd[i].r);
+				ww.groups[n_groups++] = *r;
+			edge = MAX(edge, a + rect_size(r, dir));
 		}
 
-		iv = interval_list_last(segs);
-		/* Corresponding to a "merged all" forward window is a null window. */
-		memset(&(bwd[n_ivs - 1]), 0, sizeof(window_t));
-		/* Initialize first real candidate if it exists. */
-		if (n_ivs > 1)
-		{
-			bwd[n_ivs - 2].r = iv->r;
-			bwd[n_ivs - 2].s = score_rect(bwd[n_ivs - 2].r);
-		}
-		/* Merge/sum up the rest. */
-		for (i = n_ivs - 3; i >= 0 && iv != NULL; i--)
-		{
-			iv = interval_list_prev(segs);
-			bwd[i].r = merge_rects(bwd[i + 1].r, iv->r);
-			bwd[i].s = score_rect(bwd[i].r);
-		}
+		/* Bounding boxes of groups 0-i and of the rest, null if empty. */
+		ww.fwd[0] = ww.groups[0];
+		for (i = 1; i < n_groups; i++)
+			ww.fwd[i] = merge_rects(ww.fwd[i - 1], ww.groups[i]);
+		memset(&(ww.bwd[n_groups - 1]), 0, sizeof(rect_t));
+		if (n_groups > 1)
+			ww.bwd[n_groups - 2] = ww.groups[n_groups - 1];
+		for (i = n_groups - 3; i >= 0; i--)
+			ww.bwd[i] = merge_rects(ww.bwd[i + 1], ww.groups[i + 1]);
 
 		/* Find best pair of two windows. */
-		for (i = 0; i < n_ivs; i++)
-			if (fwd[i].s + bwd[i].s < score || score == -1)
+		for (i = 0; i < n_groups; i++)
+		{
+			s = score_rect(ww.fwd[i]) + score_rect(ww.bwd[i]);
+			if (s < score || score == -1)
 			{
-				score = fwd[i].s + bwd[i].s;
-				best[0] = fwd[i].r;
-				best[1] = bwd[i].r;
+				score = s;
+				best[0] = ww.fwd[i];
+				best[1] = ww.bwd[i];
 			}
-
-		/* Cleanup. */
-		free(bwd);
-		free(fwd);
-		interval_list_destroy_deep(segs);
+		}
 	}
+	free(heap);
 
 	/* Is any of the best rectangles not null? */
 	if ((best[0].w != 0 && best[0].h != 0) || (best[1].w != 0 && best[1].h != 0))
@@ -534,9 +594,6 @@ int find_windows (rect_t *rects, int n_rects, rect_t *windows)
 		memcpy(windows, best, 2 * sizeof(rect_t));
 	}
 
-	/* Cleanup. */
-	free(sorted);
-
 	return found;
 }
 
@@ -546,9 +603,9 @@ void enforce_even_y (crop_t *c, int n)
 
 	if (!n)
 		return;
-	/* Since block borders used to auto split always lie on even rows, y will
-	 * only be odd when it was shrunk to below a block border, meaning expanding it
-	 * back up by one row should be harmless and never lead to overlap.
+	/* Windows from auto_split already start on even rows, when asked to, and
+	 * were checked for overlap that way. A single crop cannot overlap anything,
+	 * so expanding it up by one row is harmless.
 	 */
 	mod = c[0].y % 2;
 	c[0].y -= mod;
@@ -41,7 +41,13 @@ typedef struct crop_s
 typedef crop_t rect_t;
 
 void auto_crop (pic_t p, crop_t *c);
+void enforce_min_size (pic_t p, crop_t *c);
+/* Returns 1, if all non-zero pixels of p inside of area are also inside of
+ * one of the n crops in c */
+int crops_cover (pic_t p, crop_t area, crop_t *c, int n);
 int find_windows (crop_t *rects, int n_rects, crop_t *windows);
+/* Splits p into up to two windows, which together cover every non-zero
+ * pixel of p, also after enforce_even_y */
 int auto_split (pic_t p, crop_t *c, int ugly, int even_y);
 rect_t merge_rects (rect_t r1, rect_t r2);
 int score_rect (rect_t r);
@@ -15,6 +15,38 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *----------------------------------------------------------------------------
+ * Version 2.10
+ *   - Read frames ahead in a separate thread (-r)
+ *   - Linux build fixes
+ *   - Linux: Memory map raw RGBA input, and make --seek work there
+ *   - Input frames are no longer modified, transparent pixels are zeroed in
+ *     the output copy instead
+ *   - Linux: Read dimensions, frame rate and frame count from a header line
+ *     in raw input files
+ *   - Linux: Read raw input from stdin or pipes, until the end of input
+ *   - SSE2, AVX2 and AVX-512BW frame functions, selected once at startup
+ *   - Fixed SSE2 empty frame check only looking at every other pixel pair
+ *   - Check for empty and duplicate frames, and prepare the output image and
+ *     its bounding box in a single pass over each frame
+ *   - Track which 64x64 tiles changed from one frame to the next
+ *   - Reuse PNG files and SUP image data of events repeating earlier
+ *     images, found by a 64-bit content hash (-D)
+ *   - Crop, palletize and encode event images in worker threads, committing
+ *     events in frame order (-T)
+ *   - Write the PNG files of each event in parallel, with a configurable
+ *     number of events in flight (-B)
+ *   - Built-in PNG encoder for palettized subtitle images, much faster than
+ *     libpng and zlib, selected by PNG level (-L)
+ *   - Images with at most 254 colors are palettized exactly, without
+ *     going through the octree
+ *   - SUP: Events only fading the previous image in or out are written as
+ *     palette updates, without image data (-P)
+ *   - Split images for buffer optimization (-b) along connected components
+ *     of their pixels instead of a fixed 24x24 grid, picking the pair of
+ *     windows with the least total area
+ *   - Keep the crops of the previous event, if the image only changed inside
+ *     of them and they still fit it closely, so SUP compositions continue
+ *
  * Version 2.09
  *   - Added parameter -F to mark all subtitles forced
  *
@@ -150,6 +182,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
 #include <limits.h>
 #include <time.h>
 #include <png.h>
@@ -160,6 +195,11 @@
 #include "sup.h"
 #include "ass.h"
 #include "abstract_lists.h"
+#include "frame.h"
+#include "frame_reader.h"
+#include "image_cache.h"
+#include "worker_pool.h"
+#include "png_writer.h"
 
 /* AVIS input code taken from muxers.c from the x264 project (GPLv2 or later).
  * Authors: Laurent Aimar <fenrir@via.ecp.fr>
@@ -169,6 +209,13 @@
 #ifndef LINUX
 #include <windows.h>
 #include <vfw.h>
+#else
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define MAX_PATH PATH_MAX
 #endif
 
 #ifndef LINUX
@@ -193,16 +240,112 @@ typedef struct {
     int fps_num;
     int frames;
     FILE *fh;
+    int64_t frame_size;
+    int64_t data_offset;
+    int next_frame;
+    char *map;
+    size_t map_size;
+    char probe[8]; /* Bytes read looking for a header, that belong to the first frame */
+    int probe_len;
 #endif
     int width, height;
 } avis_input_t;
 
-typedef struct {
-    int i_width;
-    int i_height;
-    int i_fps_den;
-    int i_fps_num;
-} stream_info_t;
+#if defined(LINUX)
+/* Raw input may start with a single header line like:
+ *   RAWRGBA W1920 H1080 F24000:1001 N34000
+ * Width and height are required, frame rate and frame count are optional.
+ * Frame data starts at the next multiple of 64 bytes after the newline, so
+ * frames stay aligned. Frames are fixed size, so frame n is found at
+ * data offset + n * frame size. Input without header is read as 1920x1080.
+ */
+#define RAW_MAGIC "RAWRGBA"
+#define RAW_HEADER_MAX 1024
+#define RAW_ALIGN 64
+
+static int parse_raw_header( avis_input_t *h, int *frames )
+{
+    char line[RAW_HEADER_MAX + 1] = {0};
+    char *tok, *save;
+    int len = 0, c;
+
+    *frames = -1;
+
+    /* Peek for the magic, without header we read legacy raw input */
+    while( len < (int)strlen(RAW_MAGIC) && (c = fgetc(h->fh)) != EOF )
+        line[len++] = c;
+    if( len < (int)strlen(RAW_MAGIC) || memcmp(line, RAW_MAGIC, len) )
+    {
+        /* Rewind, or keep the bytes for the first frame on pipes */
+        if( !fseeko(h->fh, 0, SEEK_SET) )
+            return 0;
+        memcpy( h->probe, line, len );
+        h->probe_len = len;
+        return 0;
+    }
+
+    while( (c = fgetc(h->fh)) != EOF && c != '\n' && len < RAW_HEADER_MAX )
+        line[len++] = c;
+    if( c != '\n' )
+    {
+        fprintf( stderr, "raw [error]: header not terminated\n" );
+        return -1;
+    }
+    h->data_offset = (len + 1 + RAW_ALIGN - 1) / RAW_ALIGN * RAW_ALIGN;
+
+    /* Skip padding */
+    for( c = len + 1; c < h->data_offset; c++ )
+        if( fgetc(h->fh) == EOF )
+            return -1;
+
+    h->width = h->height = 0;
+    for( tok = strtok_r(line + strlen(RAW_MAGIC), " \t\r", &save); tok != NULL; tok = strtok_r(NULL, " \t\r", &save) )
+    {
+        switch( tok[0] )
+        {
+            case 'W':
+                h->width = atoi( tok + 1 );
+                break;
+            case 'H':
+                h->height = atoi( tok + 1 );
+                break;
+            case 'F':
+                if( sscanf(tok + 1, "%d:%d", &h->fps_num, &h->fps_den) != 2 || h->fps_num <= 0 || h->fps_den <= 0 )
+                {
+                    fprintf( stderr, "raw [error]: invalid frame rate: %s\n", tok );
+                    return -1;
+                }
+                break;
+            case 'N':
+                *frames = atoi( tok + 1 );
+                break;
+            default:
+                /* Ignore unknown parameters, like y4m does */
+                break;
+        }
+    }
+
+    if( h->width <= 0 || h->height <= 0 || h->width > 16384 || h->height > 16384 )
+    {
+        fprintf( stderr, "raw [error]: invalid dimensions in header: %dx%d\n", h->width, h->height );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Reads like fread, but starts with the bytes left from parse_raw_header */
+static size_t read_raw( avis_input_t *h, char *buf, size_t size )
+{
+    size_t n = MIN( (size_t)h->probe_len, size );
+
+    memcpy( buf, h->probe, n );
+    memmove( h->probe, h->probe + n, h->probe_len - n );
+    h->probe_len -= n;
+
+    return n + fread( buf + n, 1, size - n, h->fh );
+}
+#endif
 
 int open_file_avis( char *psz_filename, avis_input_t **p_handle, stream_info_t *p_param )
 {
@@ -217,14 +360,14 @@ int open_file_avis( char *psz_filename, avis_input_t **p_handle, stream_info_t *
     if( AVIStreamOpenFromFile( &h->p_avi, psz_filename, streamtypeVIDEO, 0, OF_READ, NULL ) )
     {
         AVIFileExit();
-        return -1;
+        goto fail;
     }
 
     if( AVIStreamInfo(h->p_avi, &info, sizeof(AVISTREAMINFO)) )
     {
         AVIStreamRelease(h->p_avi);
         AVIFileExit();
-        return -1;
+        goto fail;
     }
 
     /* Check input format */
@@ -237,7 +380,7 @@ int open_file_avis( char *psz_filename, avis_input_t **p_handle, stream_info_t *
         AVIStreamRelease(h->p_avi);
         AVIFileExit();
 
-        return -1;
+        goto fail;
     }
 
     h->width =
@@ -255,21 +398,87 @@ int open_file_avis( char *psz_filename, avis_input_t **p_handle, stream_info_t *
 
     return 0;
 #else
+    struct stat st;
+    void *map;
+    int frames;
+
     *p_handle = h;
-    p_param->i_width = 1920;
-    p_param->i_height = 1080;
-    p_param->i_fps_den = 30000;
-    p_param->i_fps_num = 1001;
-    h->width = p_param->i_width;
-    h->height = p_param->i_height;
-    h->fps_den = p_param->i_fps_den;
-    h->fps_num = p_param->i_fps_num;
-    h->fh = fopen(psz_filename, "r");
-    h->frames = 15000;
-		return 0;
+    h->width = 1920;
+    h->height = 1080;
+    h->fps_den = 1001;
+    h->fps_num = 30000;
+    h->data_offset = 0;
+    h->next_frame = 0;
+    h->map = NULL;
+    h->map_size = 0;
+    h->probe_len = 0;
+
+    /* "-" reads from stdin, as do named pipes given by name */
+    if( !strcmp(psz_filename, "-") )
+        h->fh = stdin;
+    else if( (h->fh = fopen(psz_filename, "rb")) == NULL )
+    {
+        perror( "raw [error]: cannot open input" );
+        goto fail;
+    }
+    if( fstat(fileno(h->fh), &st) || parse_raw_header(h, &frames) )
+    {
+        if( h->fh != stdin )
+            fclose( h->fh );
+        goto fail;
+    }
+
+    p_param->i_width = h->width;
+    p_param->i_height = h->height;
+    p_param->i_fps_den = h->fps_den;
+    p_param->i_fps_num = h->fps_num;
+    h->frame_size = (int64_t)h->width * h->height * 4;
+
+    /* Trust the header's frame count only as far as the file goes. Streams
+     * without frame count are read until EOF. */
+    if( !S_ISREG(st.st_mode) )
+        h->frames = frames;
+    else
+    {
+        h->frames = (st.st_size - h->data_offset) / h->frame_size;
+        if( frames >= 0 && frames < h->frames )
+            h->frames = frames;
+    }
+
+    /* Map regular files, so frames can be handed out without copying. Frames
+     * have to stay 16 byte aligned and allow for the kernels' block size. */
+    if( S_ISREG(st.st_mode) && st.st_size > 0 && (size_t)st.st_size == st.st_size &&
+        h->frame_size % 64 == 0 && h->data_offset % 64 == 0 )
+    {
+        map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(h->fh), 0 );
+        if( map != MAP_FAILED )
+        {
+            h->map = map;
+            h->map_size = st.st_size;
+            madvise( h->map, h->map_size, MADV_SEQUENTIAL );
+        }
+    }
+
+    if( h->frames < 0 )
+        fprintf( stderr, "raw [info]: %dx%d @ %.2f fps (streaming)\n",
+            p_param->i_width, p_param->i_height,
+            (double)p_param->i_fps_num / (double)p_param->i_fps_den );
+    else
+        fprintf( stderr, "raw [info]: %dx%d @ %.2f fps (%d frames)%s\n",
+            p_param->i_width, p_param->i_height,
+            (double)p_param->i_fps_num / (double)p_param->i_fps_den,
+            h->frames, h->map != NULL ? ", mapped" : "" );
+
+    return 0;
 #endif
+
+fail:
+    free( h );
+    *p_handle = NULL;
+    return -1;
 }
 
+/* Returns -1, if the number of frames is not known in advance */
 int get_frame_total_avis( avis_input_t *handle )
 {
 #if !defined(LINUX)
@@ -295,11 +504,66 @@ int read_frame_avis( char *p_pic, avis_input_t *handle, int i_frame )
 
     return 0;
 #else
-    fread(p_pic, 4, handle->width * handle->height, handle->fh);
+    avis_input_t *h = handle;
+
+    if( h->frames >= 0 && i_frame >= h->frames )
+        return 1;
+
+    if( h->map != NULL )
+    {
+        memcpy( p_pic, h->map + h->data_offset + i_frame * h->frame_size, h->frame_size );
+        return 0;
+    }
+
+    /* Only seek when not reading sequentially, pipes can only skip ahead */
+    if( i_frame != h->next_frame &&
+        fseeko( h->fh, h->data_offset + i_frame * h->frame_size, SEEK_SET ) )
+    {
+        if( i_frame < h->next_frame )
+            return -1;
+        while( h->next_frame < i_frame )
+        {
+            if( read_raw(h, p_pic, h->frame_size) != h->frame_size )
+                return ferror( h->fh ) ? -1 : 1;
+            h->next_frame++;
+        }
+    }
+    if( read_raw(h, p_pic, h->frame_size) != h->frame_size )
+        return ferror( h->fh ) ? -1 : 1;
+    h->next_frame = i_frame + 1;
+
     return 0;
 #endif
 }
 
+/* Returns a pointer to the frame inside the mapped input, or NULL if frames
+ * have to be read into a buffer using read_frame_avis. */
+char *map_frame_avis( avis_input_t *handle, int i_frame )
+{
+#if !defined(LINUX)
+    return NULL;
+#else
+    avis_input_t *h = handle;
+    char *frame, *next;
+    long page = sysconf(_SC_PAGESIZE);
+
+    if( h->map == NULL || i_frame < 0 || i_frame >= h->frames )
+        return NULL;
+
+    frame = h->map + h->data_offset + i_frame * h->frame_size;
+
+    /* Start reading the following frame into the page cache */
+    if( i_frame + 1 < h->frames )
+    {
+        next = frame + h->frame_size;
+        next -= (uintptr_t)next % page;
+        madvise( next, frame + 2 * h->frame_size - next, MADV_WILLNEED );
+    }
+
+    return frame;
+#endif
+}
+
 int close_file_avis( avis_input_t *handle )
 {
 #if !defined(LINUX)
@@ -309,7 +573,12 @@ int close_file_avis( avis_input_t *handle )
     free(h);
     return 0;
 #else
-    fclose((FILE *)handle);
+    avis_input_t *h = handle;
+    if( h->map != NULL )
+        munmap( h->map, h->map_size );
+    if( h->fh != stdin )
+        fclose( h->fh );
+    free( h );
     return 0;
 #endif
 }
@@ -320,6 +589,24 @@ int close_file_avis( avis_input_t *handle )
 
 void get_dir_path(char *filename, char *dir_path)
 {
+#ifdef LINUX
+	char tmp[MAX_PATH + 1] = {0};
+
+	/* Get absolute path of directory containing the output XML file */
+	strncpy(tmp, filename, MAX_PATH);
+	if (realpath(dirname(tmp), dir_path) == NULL)
+	{
+		fprintf(stderr, "Cannot determine absolute path for: %s\n", filename);
+		exit(1);
+	}
+	strcat(dir_path, "/");
+
+	if (strlen(dir_path) > MAX_PATH - 16)
+	{
+		fprintf(stderr, "Path for PNG files too long.\n");
+		exit(1);
+	}
+#else
 	char abs_path[MAX_PATH + 1] = {0};
 	char drive[3] = {0};
 	char dir[MAX_PATH + 1] = {0};
@@ -341,9 +628,19 @@ void get_dir_path(char *filename, char *dir_path)
 		fprintf(stderr, "Path for PNG files too long.\n");
 		exit(1);
 	}
+#endif
 }
 
-void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic, uint32_t *pal, crop_t c)
+void png_filename (char *filename, char *dir, int file_id, int graphic)
+{
+	char tmp[16] = {0};
+
+	snprintf(tmp, 15, "%08d_%d.png", file_id, graphic);
+	strncpy(filename, dir, MAX_PATH);
+	strncat(filename, tmp, 15);
+}
+
+void write_png(char *filename, uint8_t *image, int w, int h, uint32_t *pal, crop_t c, int level)
 {
 	FILE *fh;
 	png_structp png_ptr;
@@ -351,23 +648,32 @@ void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic
 	png_bytep *row_pointers;
 	png_colorp palette = NULL;
 	png_bytep trans = NULL;
-	char tmp[16] = {0};
-	char filename[MAX_PATH + 1] = {0};
+	uint8_t *png;
 	char *col;
 	int step = pal == NULL ? 4 : 1;
 	int colors = 0;
+	int size;
 	int i;
 
-	snprintf(tmp, 15, "%08d_%d.png", file_id, graphic);
-	strncpy(filename, dir, MAX_PATH);
-	strncat(filename, tmp, 15);
-
 	if ((fh = fopen(filename, "wb")) == NULL)
 	{
 		perror("Cannot open PNG file for writing");
 		exit(1);
 	}
 
+	/* Built-in encoder for lower levels */
+	if (level <= PNG_MAX_FAST_LEVEL)
+	{
+		png = encode_png(image, w, pal, c, level, &size);
+		if (fwrite(png, size, 1, fh) != 1 || fclose(fh))
+		{
+			fprintf(stderr, "Error while writing PNG file: %s\n", filename);
+			exit(1);
+		}
+		free(png);
+		return;
+	}
+
 	/* Initialize png struct */
 	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (png_ptr == NULL)
@@ -432,7 +738,7 @@ void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic
 
 	/* Set compression */
 	png_set_filter(png_ptr, 0, PNG_FILTER_VALUE_SUB);
-	png_set_compression_level(png_ptr, 5);
+	png_set_compression_level(png_ptr, level);
 
 	/* Write image */
 	png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
@@ -449,132 +755,6 @@ void write_png(char *dir, int file_id, uint8_t *image, int w, int h, int graphic
 	fclose(fh);
 }
 
-extern int asm_is_identical_sse2 (stream_info_t *s_info, char *img, char *img_old);
-extern int asm_is_empty_sse2 (stream_info_t *s_info, char *img);
-extern void asm_zero_transparent_sse2 (stream_info_t *s_info, char volatile *img);
-extern void asm_swap_rb_sse2 (stream_info_t *s_info, char volatile *img, char volatile *out);
-
-int is_identical_c (stream_info_t *s_info, char *img, char *img_old)
-{
-	uint32_t *max = (uint32_t *)(img + s_info->i_width * s_info->i_height * 4);
-	uint32_t *im = (uint32_t *)img;
-	uint32_t *im_old = (uint32_t *)img_old;
-
-	while (im < max)
-	{
-		if (!((char *)im)[3])
-			*im = 0;
-		if (*(im++) ^ *(im_old++))
-			return 0;
-	}
-
-	return 1;
-}
-
-int is_empty_c (stream_info_t *s_info, char *img)
-{
-	char *max = img + s_info->i_width * s_info->i_height * 4;
-	char *im = img;
-
-	while (im < max)
-	{
-		if (im[3])
-			return 0;
-		im += 4;
-	}
-
-	return 1;
-}
-
-void zero_transparent_c (stream_info_t *s_info, char *img)
-{
-	char *max = img + s_info->i_width * s_info->i_height * 4;
-	char *im = img;
-
-	while (im < max)
-	{
-		if (!im[3])
-			*(uint32_t *)img = 0;
-		im += 4;
-	}
-}
-
-void swap_rb_c (stream_info_t *s_info, char *img, char *out)
-{
-	char *max = img + s_info->i_width * s_info->i_height * 4;
-
-	while (img < max)
-	{
-		out[0] = img[2];
-		out[1] = img[1];
-		out[2] = img[0];
-		out[3] = img[3];
-		img += 4;
-		out += 4;
-	}
-}
-
-int detect_sse2 ()
-{
-	static int detection = -1;
-	unsigned int func = 0x00000001;
-	unsigned int eax, ebx, ecx, edx;
-
-	if (detection != -1)
-		return detection;
-
-	asm volatile
-	(
-		"cpuid\n"
-		: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
-		: "a" (func)
-	);
-
-	/* SSE2:  edx & 0x04000000
-	 * SSSE3: ecx & 0x00000200
-	 */
-	detection = (edx & 0x04000000) ? 1 : 0;
-
-	if (detection)
-		fprintf(stderr, "CPU: Using SSE2 optimized functions.\n");
-	else
-		fprintf(stderr, "CPU: Using pure C functions.\n");
-
-	return detection;
-}
-
-int is_identical (stream_info_t *s_info, char *img, char *img_old)
-{
-	if (detect_sse2())
-		return asm_is_identical_sse2(s_info, img, img_old);
-	else
-		return is_identical_c(s_info, img, img_old);
-}
-
-int is_empty (stream_info_t *s_info, char *img)
-{
-	if (detect_sse2())
-		return asm_is_empty_sse2(s_info, img);
-	else
-		return is_empty_c(s_info, img);
-}
-
-void zero_transparent (stream_info_t *s_info, char *img)
-{
-	if (detect_sse2())
-		return asm_zero_transparent_sse2(s_info, img);
-	else
-		return zero_transparent_c(s_info, img);
-}
-
-void swap_rb (stream_info_t *s_info, char *img, char *out)
-{
-	if (detect_sse2())
-		return asm_swap_rb_sse2(s_info, img, out);
-	else
-		return swap_rb_c(s_info, img, out);
-}
-
 /* SMPTE non-drop time code */
 void mk_timecode (int frame, int fps, char *buf) /* buf must have length 12 (incl. trailing \0) */
 {
@@ -606,7 +786,7 @@ void mk_timecode (int frame, int fps, char *buf) /* buf must have length 12 (inc
 void print_usage ()
 {
 	fprintf(stderr,
-		"avs2bdnxml 2.09\n\n"
+		"avs2bdnxml 2.10\n\n"
 		"Usage: avs2bdnxml [options] -o output input\n\n"
 		"Input has to be an AviSynth script with RGBA as output colorspace\n\n"
 		"  -o, --output <string>        Output file in BDN XML format\n"
@@ -637,6 +817,21 @@ void print_usage ()
 		"                               [on=1, off=0]\n"
 		"  -b, --buffer-opt <integer>   Optimize PG buffer size by image\n"
 		"                               splitting. [on=1, off=0]\n"
+		"  -r, --read-ahead <integer>   Number of frames to read ahead in a separate\n"
+		"                               thread. Synchronous reading when 0.\n"
+		"  -D, --dedupe <integer>       Reuse images and encoded data of events\n"
+		"                               identical to earlier ones. [on=1, off=0]\n"
+		"  -T, --threads <integer>      Number of threads for cropping, palletizing\n"
+		"                               and encoding images. In the main thread\n"
+		"                               when 0. Defaults to the number of CPUs.\n"
+		"  -B, --backlog <integer>      Number of events being processed, before\n"
+		"                               reading further frames waits for them.\n"
+		"                               Defaults to twice the number of threads.\n"
+		"  -L, --png-level <integer>    PNG compression level. 0 to 3 use a faster\n"
+		"                               built-in encoder, 4 to 9 libpng. [0-9]\n"
+		"  -P, --fade-palette <integer> Write events only fading the previous image\n"
+		"                               as palette updates in SUP output.\n"
+		"                               [on=1, off=0]\n"
         "  -F, --forced <integer>       mark all subtitles as forced [on=1, off=0]\n\n"
 		"Example:\n"
 		"  avs2bdnxml -t Undefined -l und -v 1080p -f 23.976 -a1 -p1 -b0 -m3 \\\n"
@@ -738,9 +933,8 @@ void add_event_xml_real (event_list_t *events, int image, int start, int end, in
 	event_list_insert_after(events, new);
 }
 
-void add_event_xml (event_list_t *events, int split_at, int min_split, int start, int end, int graphics, crop_t *crops, int forced)
+void add_event_xml (event_list_t *events, int split_at, int min_split, int image, int start, int end, int graphics, crop_t *crops, int forced)
 {
-	int image = start;
 	int d = end - start;
 
 	if (!split_at)
@@ -758,26 +952,509 @@ void add_event_xml (event_list_t *events, int split_at, int min_split, int start
 	}
 }
 
-void write_sup_wrapper (sup_writer_t *sw, uint8_t *im, int num_crop, crop_t *crops, uint32_t *pal, int start, int end, int split_at, int min_split, int stricter, int forced)
+void write_sup_wrapper (sup_writer_t *sw, uint8_t *im, int num_crop, crop_t *crops, uint32_t *pal, int start, int end, int split_at, int min_split, int stricter, int forced, sup_rle_t *reuse)
 {
 	int d = end - start;
 
 	if (!split_at)
-		write_sup(sw, im, num_crop, crops, pal, start, end, stricter, forced);
+		write_sup(sw, im, num_crop, crops, pal, start, end, stricter, forced, reuse);
 	else
 	{
 		while (d >= split_at + min_split)
 		{
 			d -= split_at;
-			write_sup(sw, im, num_crop, crops, pal, start, start + split_at, stricter, forced);
+			write_sup(sw, im, num_crop, crops, pal, start, start + split_at, stricter, forced, reuse);
 			start += split_at;
 		}
 		if (d)
-			write_sup(sw, im, num_crop, crops, pal, start, start + d, stricter, forced);
+			write_sup(sw, im, num_crop, crops, pal, start, start + d, stricter, forced, reuse);
 	}
 }
 
 
+/* Output image, with the bounding box of rows which may be non-zero */
+typedef struct out_buf_s
+{
+	char *raw;
+	char *data;
+	crop_t bbox;
+	struct out_buf_s *next;
+} out_buf_t;
+
+/* Everything needed to process and commit events */
+typedef struct event_ctx_s
+{
+	worker_pool_t *pool;
+	char *png_dir;
+	int w;
+	int h;
+	int buffer_opt;
+	int autocrop;
+	int even_y;
+	int ugly;
+	int pal_png;
+	int xml_output;
+	int png_level;
+	sup_writer_t *sw;
+	event_list_t *events;
+	int to;
+	int split_at;
+	int min_split;
+	int stricter;
+	int forced;
+	int fades;               /* Write fades of an image as palette updates */
+	char *fade_base;         /* Last image fades are compared to */
+	crop_t fade_bbox;
+	int have_base;
+	int base_committed;      /* Last event committed to sw was fade_base */
+	uint32_t base_pal[256];
+	int have_crops;          /* Crops of the last event, the next may keep */
+	int n_last_crop;
+	crop_t last_crops[2];
+	struct event_job_s *head; /* Events in frame order, not yet committed */
+	struct event_job_s *tail;
+	out_buf_t *free_bufs;
+	int n_bufs;
+	int max_bufs;
+} event_ctx_t;
+
+/* Writing of one PNG file of an event, queued separately so the crops of an
+ * event are compressed in parallel */
+typedef struct png_job_s
+{
+	work_t work;
+	struct event_job_s *event;
+	char filename[MAX_PATH + 1];
+	int graphic;
+} png_job_t;
+
+/* An event image, cropped, palletized and encoded by a worker. Results are
+ * committed to the XML event list and SUP writer in frame order, once the
+ * worker is done and the end of the event is known. */
+typedef struct event_job_s
+{
+	work_t work;
+	event_ctx_t *ctx;
+	out_buf_t *buf;
+	crop_t bbox;
+	int start;
+	int end;
+	int closed;
+	int image;
+	int repeat;                 /* Results are taken from entry */
+	image_cache_entry_t *entry; /* Filled by this event, unless repeat */
+	int fade;                   /* Fade of the base image, by alpha_scale */
+	uint32_t alpha_scale;
+	int n_crop;
+	crop_t crops[2];
+	uint32_t *pal;
+	sup_rle_t rle;
+	int n_png;
+	png_job_t pngs[2];
+	struct event_job_s *next;
+} event_job_t;
+
+static out_buf_t *new_out_buf (int size)
+{
+	out_buf_t *b = calloc(1, sizeof(out_buf_t));
+
+	b->raw = calloc(size + FRAME_ALIGN + FRAME_PADDING, sizeof(char)); /* allocate + FRAME_ALIGN for alignment, and + FRAME_PADDING for over read/write */
+	if (b->raw == NULL)
+	{
+		fprintf(stderr, "Error: Cannot allocate output buffer.\n");
+		exit(1);
+	}
+	b->data = b->raw + (short)(FRAME_ALIGN - ((long)b->raw % FRAME_ALIGN));
+
+	return b;
+}
+
+/* Runs in a worker thread */
+static void write_event_png (void *arg)
+{
+	png_job_t *p = arg;
+	event_job_t *job = p->event;
+
+	write_png(p->filename, (uint8_t *)job->buf->data, job->ctx->w, job->ctx->h, job->pal, job->crops[p->graphic], job->ctx->png_level);
+}
+
+/* Runs in a worker thread */
+static void process_event (void *arg)
+{
+	event_job_t *job = arg;
+	event_ctx_t *ctx = job->ctx;
+	image_cache_entry_t *e = job->entry;
+	char *im = job->buf->data;
+	crop_t c, *b;
+	pic_t pic;
+	int y0, y1;
+	int j;
+
+	/* Only needed for SUP output, if the palette update cannot be used */
+	if (job->fade && !ctx->xml_output)
+		return;
+
+	pic.b = im;
+	pic.w = ctx->w;
+	pic.h = ctx->h;
+	pic.s = ctx->w;
+	if (ctx->pal_png || ctx->sw != NULL)
+	{
+		job->pal = palletize((uint8_t *)im, pic.w, pic.h, job->n_crop, job->crops);
+
+		/* Indices are packed into the first quarter of the buffer, so
+		 * those rows are no longer zero for classify */
+		for (j = 0; j < job->n_crop; j++)
+		{
+			c = job->crops[j];
+			y0 = (c.x + c.y * pic.w) / (pic.w * 4);
+			y1 = (c.x + c.w - 1 + (c.y + c.h - 1) * pic.w) / (pic.w * 4) + 1;
+			b = &(job->buf->bbox);
+			b->h = MAX(b->y + b->h, y1) - MIN(b->y, y0);
+			b->y = MIN(b->y, y0);
+		}
+	}
+	if (ctx->xml_output)
+	{
+		/* The buffer and palette are kept until the event is committed */
+		job->n_png = job->n_crop;
+		for (j = 0; j < job->n_png; j++)
+		{
+			job->pngs[j].event = job;
+			job->pngs[j].graphic = j;
+			png_filename(job->pngs[j].filename, ctx->png_dir, job->image, j);
+			worker_pool_submit(ctx->pool, &(job->pngs[j].work), write_event_png, &(job->pngs[j]));
+		}
+	}
+	/* Cached fades may be repeated as images later */
+	if (ctx->sw != NULL && (!job->fade || e != NULL))
+		encode_sup_rle(e != NULL ? &(e->rle) : &(job->rle), (uint8_t *)im, pic.w, pic.h, job->n_crop, job->crops);
+
+	if (e != NULL && job->pal != NULL)
+	{
+		memcpy(e->pal, job->pal, 256 * sizeof(uint32_t));
+		e->have_pal = 1;
+	}
+}
+
+/* Write a fade as palette update of the objects of its base image. Returns 0,
+ * if the event has to be written as image instead, after preparing that. */
+static int commit_fade (event_job_t *job)
+{
+	event_ctx_t *ctx = job->ctx;
+	uint32_t pal[256];
+	uint8_t *v;
+	int i;
+
+	if (ctx->base_committed && (!ctx->split_at || job->end - job->start <= ctx->split_at))
+	{
+		/* Transparent black would end the palette, keep it non-zero */
+		memset(pal, 0, sizeof(pal));
+		for (i = 1; i < 256 && ctx->base_pal[i]; i++)
+		{
+			pal[i] = ctx->base_pal[i];
+			v = (uint8_t *)&(pal[i]);
+			v[3] = MIN(255, (v[3] * job->alpha_scale + 32768) >> 16);
+			if (!pal[i])
+				v[0] = 1;
+		}
+		if (write_sup_palette(ctx->sw, pal, job->start + ctx->to, job->end + ctx->to, ctx->stricter))
+			return 1;
+	}
+
+	job->fade = 0;
+	if (job->repeat)
+		return 0;
+	if (job->pal == NULL)
+		process_event(job);
+	else if (job->entry == NULL)
+		encode_sup_rle(&(job->rle), (uint8_t *)job->buf->data, ctx->w, ctx->h, job->n_crop, job->crops);
+
+	return 0;
+}
+
+static void commit_event (event_job_t *job)
+{
+	event_ctx_t *ctx = job->ctx;
+	image_cache_entry_t *e = job->entry;
+	crop_t crops[2];
+	uint32_t *pal;
+	sup_rle_t *rle = e != NULL ? &(e->rle) : &(job->rle);
+	int n_crop;
+
+	if (job->fade && ctx->sw != NULL && commit_fade(job))
+	{
+		if (ctx->xml_output)
+			add_event_xml(ctx->events, ctx->split_at, ctx->min_split, job->image + ctx->to, job->start + ctx->to, job->end + ctx->to, job->n_crop, job->crops, ctx->forced);
+		return;
+	}
+
+	pal = job->pal;
+	n_crop = job->n_crop;
+	memcpy(crops, job->crops, sizeof(crops));
+	if (job->repeat)
+	{
+		n_crop = e->num_crop;
+		memcpy(crops, e->crops, sizeof(crops));
+		pal = e->pal;
+	}
+
+	if (ctx->sw != NULL)
+	{
+		assert(pal != NULL);
+		write_sup_wrapper(ctx->sw, NULL, n_crop, crops, pal, job->start + ctx->to, job->end + ctx->to, ctx->split_at, ctx->min_split, ctx->stricter, ctx->forced, rle);
+
+		/* Following fades refer to this image, unless it is a fade that had
+		 * to be written as image */
+		ctx->base_committed = job->alpha_scale == 0;
+		if (ctx->base_committed)
+			memcpy(ctx->base_pal, pal, sizeof(ctx->base_pal));
+	}
+	if (ctx->xml_output)
+		add_event_xml(ctx->events, ctx->split_at, ctx->min_split, job->image + ctx->to, job->start + ctx->to, job->end + ctx->to, n_crop, crops, ctx->forced);
+}
+
+/* Returns 1, if the event and all of its PNG files are finished. If wait is
+ * set, wait for them first. PNG jobs are only known once the event is done. */
+static int event_done (event_ctx_t *ctx, event_job_t *job, int wait)
+{
+	int j;
+
+	if (job->repeat)
+		return 1;
+	if (wait)
+		worker_pool_wait(ctx->pool, &(job->work));
+	else if (!worker_pool_done(ctx->pool, &(job->work)))
+		return 0;
+	for (j = 0; j < job->n_png; j++)
+	{
+		if (wait)
+			worker_pool_wait(ctx->pool, &(job->pngs[j].work));
+		else if (!worker_pool_done(ctx->pool, &(job->pngs[j].work)))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Commit finished events in frame order. If wait is set, wait for the first
+ * one to finish. */
+static void commit_events (event_ctx_t *ctx, int wait)
+{
+	event_job_t *job;
+
+	while ((job = ctx->head) != NULL && job->closed)
+	{
+		if (!event_done(ctx, job, wait))
+			break;
+		wait = 0;
+
+		commit_event(job);
+
+		ctx->head = job->next;
+		if (ctx->head == NULL)
+			ctx->tail = NULL;
+		if (job->buf != NULL)
+		{
+			job->buf->next = ctx->free_bufs;
+			ctx->free_bufs = job->buf;
+		}
+		if (job->entry != NULL)
+			image_cache_release(job->entry);
+		if (job->pal != NULL)
+			free(job->pal);
+		free_sup_rle(&(job->rle));
+		free(job);
+	}
+}
+
+/* Get an unused output buffer, waiting for events to finish if too many are
+ * in flight */
+static out_buf_t *get_out_buf (event_ctx_t *ctx)
+{
+	out_buf_t *b;
+
+	while (ctx->free_bufs == NULL && ctx->n_bufs >= ctx->max_bufs)
+	{
+		assert(ctx->head != NULL && ctx->head->closed);
+		commit_events(ctx, 1);
+	}
+	if (ctx->free_bufs == NULL)
+	{
+		ctx->n_bufs++;
+		return new_out_buf(ctx->w * ctx->h * 4);
+	}
+	b = ctx->free_bufs;
+	ctx->free_bufs = b->next;
+
+	return b;
+}
+
+/* Largest distance in pixels between an edge of the kept crops and the image,
+ * before they are chosen again */
+#define CROP_SLACK 8
+
+/* Returns 1, if the crops of the last event still hold all pixels of buf, none
+ * of them empty, and do not exceed them by more than CROP_SLACK. Only tiles
+ * marked in dirty, the changes to the last event's image, are looked at. */
+static int keep_crops (event_ctx_t *ctx, out_buf_t *buf, pic_t pic, dirty_map_t *dirty)
+{
+	crop_t *c = ctx->last_crops;
+	crop_t t, *b = &(buf->bbox);
+	int n = ctx->n_last_crop;
+	int tx, ty, k;
+
+	if (!ctx->have_crops || (!ctx->buffer_opt && !ctx->autocrop))
+		return 0;
+	t = n > 1 ? merge_rects(c[0], c[1]) : c[0];
+	if (b->x < t.x || b->y < t.y || b->x + b->w > t.x + t.w || b->y + b->h > t.y + t.h)
+		return 0;
+	if (b->x - t.x > CROP_SLACK || b->y - t.y > CROP_SLACK || t.x + t.w - b->x - b->w > CROP_SLACK || t.y + t.h - b->y - b->h > CROP_SLACK)
+		return 0;
+
+	t.w = TILE_SIZE;
+	t.h = TILE_SIZE;
+	if (n > 1)
+		for (ty = dirty->bbox.y / TILE_SIZE; ty * TILE_SIZE < dirty->bbox.y + dirty->bbox.h; ty++)
+			for (tx = dirty->bbox.x / TILE_SIZE; tx * TILE_SIZE < dirty->bbox.x + dirty->bbox.w; tx++)
+			{
+				t.x = tx * TILE_SIZE;
+				t.y = ty * TILE_SIZE;
+				if (dirty->tiles[tx + ty * dirty->tiles_x] && !crops_cover(pic, t, c, n))
+					return 0;
+			}
+
+	/* Unchanged crops keep their pixels */
+	for (k = 0; k < n; k++)
+		if (is_dirty(dirty, c[k]) && crops_cover(pic, c[k], NULL, 0))
+			return 0;
+
+	return 1;
+}
+
+/* Crops of an event image, reusing those of the last event where possible,
+ * so SUP compositions are not restarted by crops moving by a pixel */
+static void choose_crops (event_ctx_t *ctx, event_job_t *job, dirty_map_t *dirty)
+{
+	pic_t pic;
+
+	pic.b = job->buf->data;
+	pic.w = ctx->w;
+	pic.h = ctx->h;
+	pic.s = ctx->w;
+	if (keep_crops(ctx, job->buf, pic, dirty))
+	{
+		job->n_crop = ctx->n_last_crop;
+		memcpy(job->crops, ctx->last_crops, sizeof(job->crops));
+		return;
+	}
+
+	job->n_crop = 1;
+	job->crops[0].x = 0;
+	job->crops[0].y = 0;
+	job->crops[0].w = pic.w;
+	job->crops[0].h = pic.h;
+	if (ctx->buffer_opt)
+	{
+		job->crops[0] = job->bbox;
+		job->n_crop = auto_split(pic, job->crops, ctx->ugly, ctx->even_y);
+	}
+	else if (ctx->autocrop)
+	{
+		job->crops[0] = job->bbox;
+		enforce_min_size(pic, job->crops);
+	}
+	if ((ctx->buffer_opt || ctx->autocrop) && ctx->even_y)
+		enforce_even_y(job->crops, job->n_crop);
+}
+
+/* Returns the alpha scale, if buf is a fade of the base image, or 0 */
+static uint32_t fade_of_base (event_ctx_t *ctx, out_buf_t *buf)
+{
+	crop_t *c = &(ctx->fade_bbox);
+
+	if (!ctx->have_base || buf->bbox.x < c->x || buf->bbox.y < c->y || buf->bbox.x + buf->bbox.w > c->x + c->w || buf->bbox.y + buf->bbox.h > c->y + c->h)
+		return 0;
+
+	return fade_scale(ctx->fade_base, buf->data, ctx->w, *c);
+}
+
+/* Start processing an event image from buf. Tiles changed from the last event
+ * are marked in dirty. Returns the job, which is owned by ctx. */
+static event_job_t *start_event (event_ctx_t *ctx, image_cache_t *cache, out_buf_t *buf, int start, dirty_map_t *dirty)
+{
+	event_job_t *job = calloc(1, sizeof(event_job_t));
+	image_key_t key;
+	crop_t *c;
+	int y;
+
+	job->ctx = ctx;
+	job->bbox = buf->bbox;
+	job->start = start;
+	job->image = start;
+	if (ctx->tail != NULL)
+		ctx->tail->next = job;
+	else
+		ctx->head = job;
+	ctx->tail = job;
+
+	if (cache != NULL)
+	{
+		hash_image((uint8_t *)buf->data, ctx->w, ctx->h, buf->bbox, &key);
+		job->entry = image_cache_find(cache, &key);
+	}
+	if (job->entry != NULL)
+	{
+		/* Repeat of an earlier image, reuse crops, palette and written data */
+		job->repeat = 1;
+		job->image = job->entry->image;
+		job->n_crop = job->entry->num_crop;
+		memcpy(job->crops, job->entry->crops, sizeof(job->crops));
+	}
+	else
+	{
+		/* Crops are chosen here, as the next event may keep them */
+		job->buf = buf;
+		choose_crops(ctx, job, dirty);
+	}
+	ctx->have_crops = 1;
+	ctx->n_last_crop = job->n_crop;
+	memcpy(ctx->last_crops, job->crops, sizeof(ctx->last_crops));
+
+	/* Fade of the base image, only its palette changes in SUP output. Repeats
+	 * may be fades too. With SUP output only, a fade is not cached, as it may
+	 * have no image data of its own. With XML output, its PNG files are
+	 * written anyway. */
+	c = &(ctx->fade_bbox);
+	job->alpha_scale = fade_of_base(ctx, buf);
+	job->fade = job->alpha_scale != 0;
+	if (cache != NULL && !job->repeat && (!job->fade || ctx->xml_output))
+	{
+		job->entry = image_cache_insert(cache, &key);
+		job->entry->image = start;
+		job->entry->num_crop = job->n_crop;
+		memcpy(job->entry->crops, job->crops, sizeof(job->crops));
+	}
+
+	/* Keep a copy as base for following fades, zero outside of it */
+	if (!job->fade && ctx->fades)
+	{
+		if (ctx->fade_base == NULL)
+			ctx->fade_base = calloc(ctx->w * ctx->h, 4);
+		for (y = c->y; y < c->y + c->h; y++)
+			memset(ctx->fade_base + (c->x + y * ctx->w) * 4, 0, c->w * 4);
+		*c = buf->bbox;
+		for (y = c->y; y < c->y + c->h; y++)
+			memcpy(ctx->fade_base + (c->x + y * ctx->w) * 4, buf->data + (c->x + y * ctx->w) * 4, c->w * 4);
+		ctx->have_base = 1;
+	}
+
+	if (!job->repeat)
+		worker_pool_submit(ctx->pool, &(job->work), process_event, job);
+
+	return job;
+}
+
 struct framerate_entry_s
 {
 	char *name;
@@ -824,17 +1501,25 @@ int main (int argc, char *argv[])
 	char *allow_empty_string = "0";
 	char *stricter_string = "0";
 	char *count_string = "2147483647";
-	char *in_img = NULL, *old_img = NULL, *tmp = NULL, *out_buf = NULL;
+	char *read_ahead_string = "4";
+	char *dedupe_string = "1";
+	char *threads_string = NULL;
+	char *backlog_string = NULL;
+	char *png_level_string = "3";
+	char *fade_palette_string = "1";
+	char *in_img = NULL, *old_img = NULL;
 	char *intc_buf = NULL, *outtc_buf = NULL;
 	char *drop_frame = NULL;
     char *mark_forced_string = "0";
 	char png_dir[MAX_PATH + 1] = {0};
-	crop_t crops[2];
+	dirty_map_t *dirty;
+	image_cache_t *cache = NULL;
+	out_buf_t *next_buf, *b;
+	event_ctx_t ctx;
+	event_job_t *job = NULL;
 	pic_t pic;
-	uint32_t *pal = NULL;
 	int out_filename_idx = 0;
 	int have_fps = 0;
-	int n_crop = 1;
 	int split_at = 0;
 	int min_split = 3;
 	int autocrop = 0;
@@ -845,15 +1530,20 @@ int main (int argc, char *argv[])
 	int frames;
 	int first_frame = -1, start_frame = -1, end_frame = -1;
 	int num_of_events = 0;
-	int i, c, j;
+	int i, c;
 	int have_line = 0;
-	int must_zero = 0;
-	int checked_empty;
+	int frame_type;
 	int even_y = 0;
 	int auto_cut = 0;
 	int pal_png = 1;
 	int ugly = 0;
 	int progress_step = 1000;
+	int read_ahead = 4;
+	int dedupe = 1;
+	int threads;
+	int backlog;
+	int png_level;
+	int fade_palette;
 	int buffer_opt;
 	int bench_start = time(NULL);
 	int fps_num = 25, fps_den = 1;
@@ -864,6 +1554,7 @@ int main (int argc, char *argv[])
     int mark_forced = 0;
 	sup_writer_t *sw = NULL;
 	avis_input_t *avis_hnd;
+	frame_reader_t *reader;
 	stream_info_t *s_info = malloc(sizeof(stream_info_t));
 	event_list_t *events = event_list_new();
 	event_t *event;
@@ -898,11 +1589,17 @@ int main (int argc, char *argv[])
 			, {"null-xml",     required_argument, 0, 'n'}
 			, {"stricter",     required_argument, 0, 'z'}
 			, {"forced",       required_argument, 0, 'F'}
+			, {"read-ahead",   required_argument, 0, 'r'}
+			, {"dedupe",       required_argument, 0, 'D'}
+			, {"threads",      required_argument, 0, 'T'}
+			, {"backlog",      required_argument, 0, 'B'}
+			, {"png-level",    required_argument, 0, 'L'}
+			, {"fade-palette", required_argument, 0, 'P'}
 			, {0, 0, 0, 0}
 			};
 			int option_index = 0;
 
-			c = getopt_long(argc, argv, "o:j:c:t:l:v:f:x:y:d:b:s:m:e:p:a:u:n:z:F:", long_options, &option_index);
+			c = getopt_long(argc, argv, "o:j:c:t:l:v:f:x:y:d:b:s:m:e:p:a:u:n:z:F:r:D:T:B:L:P:", long_options, &option_index);
 			if (c == -1)
 				break;
 			switch (c)
@@ -973,6 +1670,24 @@ int main (int argc, char *argv[])
 				case 'F':
 					mark_forced_string = optarg;
 					break;
+				case 'r':
+					read_ahead_string = optarg;
+					break;
+				case 'D':
+					dedupe_string = optarg;
+					break;
+				case 'T':
+					threads_string = optarg;
+					break;
+				case 'B':
+					backlog_string = optarg;
+					break;
+				case 'L':
+					png_level_string = optarg;
+					break;
+				case 'P':
+					fade_palette_string = optarg;
+					break;
 				default:
 					print_usage();
 					return 0;
@@ -1042,6 +1757,23 @@ int main (int argc, char *argv[])
 	if (!min_split)
 		min_split = 1;
 	mark_forced = parse_int(mark_forced_string, "forced", NULL);
+	read_ahead = parse_int(read_ahead_string, "read-ahead", NULL);
+	if (read_ahead < 0)
+		read_ahead = 0;
+	dedupe = parse_int(dedupe_string, "dedupe", NULL);
+	threads = threads_string != NULL ? parse_int(threads_string, "threads", NULL) : cpu_count();
+	if (threads < 0)
+		threads = 0;
+	backlog = backlog_string != NULL ? parse_int(backlog_string, "backlog", NULL) : 2 * threads;
+	if (backlog < 1)
+		backlog = 1;
+	png_level = parse_int(png_level_string, "png-level", NULL);
+	if (png_level < 0 || png_level > 9)
+	{
+		fprintf(stderr, "Error: PNG level must be between 0 and 9.\n");
+		return 1;
+	}
+	fade_palette = parse_int(fade_palette_string, "fade-palette", NULL);
 
 	/* TODO: Sanity check video_format and frame_rate. */
 
@@ -1069,8 +1801,8 @@ int main (int argc, char *argv[])
 	/* Get timecode offset. */
 	to = parse_tc(t_offset, fps);
 
-	/* Detect CPU features */
-	detect_sse2();
+	/* Detect CPU features and select frame functions */
+	init_frame_funcs();
 
 	/* Get video info and allocate buffer */
 	if (open_file_avis(avs_filename, &avis_hnd, s_info))
@@ -1078,9 +1810,6 @@ int main (int argc, char *argv[])
 		print_usage();
 		return 1;
 	}
-	in_img  = calloc(s_info->i_width * s_info->i_height * 4 + 16 * 2, sizeof(char)); /* allocate + 16 for alignment, and + n * 16 for over read/write */
-	old_img = calloc(s_info->i_width * s_info->i_height * 4 + 16 * 2, sizeof(char)); /* see above */
-	out_buf = calloc(s_info->i_width * s_info->i_height * 4 + 16 * 2, sizeof(char));
 
 	/* Check minimum size */
 	if (s_info->i_width < 8 || s_info->i_height < 8)
@@ -1089,29 +1818,21 @@ int main (int argc, char *argv[])
 		return 1;
 	}
 
-	/* Align buffers */
-	in_img  = in_img + (short)(16 - ((long)in_img % 16));
-	old_img = old_img + (short)(16 - ((long)old_img % 16));
-	out_buf = out_buf + (short)(16 - ((long)out_buf % 16));
-
 	/* Set up buffer (non-)optimization */
 	buffer_opt = parse_int(buffer_optimize, "buffer-opt", NULL);
-	pic.b = out_buf;
+	pic.b = NULL;
 	pic.w = s_info->i_width;
 	pic.h = s_info->i_height;
 	pic.s = s_info->i_width;
-	n_crop = 1;
-	crops[0].x = 0;
-	crops[0].y = 0;
-	crops[0].w = pic.w;
-	crops[0].h = pic.h;
 
-	/* Get frame number */
+	/* Get frame number, streamed input of unknown length is read until its end */
 	frames = get_frame_total_avis(avis_hnd);
-	if (count_frames + init_frame > frames)
+	if (frames >= 0 && count_frames + init_frame > frames)
 	{
 		count_frames = frames - init_frame;
 	}
+	if (count_frames > INT_MAX - init_frame)
+		count_frames = INT_MAX - init_frame;
 	last_frame = count_frames + init_frame;
 
 	/* No frames mean nothing to do */
@@ -1122,7 +1843,12 @@ int main (int argc, char *argv[])
 	}
 
 	/* Set progress step */
-	if (count_frames < 1000)
+	if (frames < 0 && count_frames == INT_MAX - init_frame)
+	{
+		count_frames = -1;
+		progress_step = 100;
+	}
+	else if (count_frames < 1000)
 	{
 		if (count_frames > 200)
 			progress_step = 50;
@@ -1136,127 +1862,157 @@ int main (int argc, char *argv[])
 	if (sup_output)
 		sw = new_sup_writer(sup_output_fn, pic.w, pic.h, fps_num, fps_den);
 
+	/* Images of earlier events, by content */
+	if (dedupe)
+		cache = new_image_cache();
+
+	/* Set up event processing, events are processed by worker threads and
+	 * committed in frame order. Each event in flight holds an output buffer,
+	 * one more is used for preparing the next image. */
+	memset(&ctx, 0, sizeof(event_ctx_t));
+	ctx.pool = new_worker_pool(threads);
+	ctx.png_dir = png_dir;
+	ctx.w = s_info->i_width;
+	ctx.h = s_info->i_height;
+	ctx.buffer_opt = buffer_opt;
+	ctx.autocrop = autocrop;
+	ctx.even_y = even_y;
+	ctx.ugly = ugly;
+	ctx.pal_png = pal_png;
+	ctx.xml_output = xml_output;
+	ctx.png_level = png_level;
+	ctx.sw = sw;
+	ctx.events = events;
+	ctx.to = to;
+	ctx.split_at = split_at;
+	ctx.min_split = min_split;
+	ctx.stricter = stricter;
+	ctx.forced = mark_forced;
+	ctx.fades = sup_output && fade_palette;
+	ctx.max_bufs = backlog + 1;
+	next_buf = get_out_buf(&ctx);
+
+	/* Tiles changed by the current frame, for later stages */
+	dirty = new_dirty_map(s_info->i_width, s_info->i_height);
+
+	/* Start reading frames, input buffers are recycled by the reader */
+	reader = new_frame_reader((frame_read_func_t)read_frame_avis, (frame_map_func_t)map_frame_avis, avis_hnd, s_info->i_width * s_info->i_height * 4, init_frame, last_frame, read_ahead);
+
 	/* Process frames */
 	for (i = init_frame; i < last_frame; i++)
 	{
-		if (read_frame_avis(in_img, avis_hnd, i))
+		/* Hand back last frame, unless it is kept for comparison */
+		if (in_img != old_img)
+			frame_reader_release(reader, in_img);
+		if ((in_img = frame_reader_get(reader)) == NULL)
 		{
+			if (!reader->error && frames < 0)
+				break;
 			fprintf(stderr, "Error reading frame.\n");
 			return 1;
 		}
-		checked_empty = 0;
 
 		/* Progress indicator */
-		if (i % (count_frames / progress_step) == 0)
+		if (count_frames < 0)
 		{
-			fprintf(stderr, "\rProgress: %d/%d - Lines: %d", i - init_frame, count_frames, num_of_events);
+			if ((i - init_frame) % progress_step == 0)
+				fprintf(stderr, "\rProgress: %d - Lines: %d", i - init_frame, num_of_events);
 		}
-
-		/* If we are outside any lines, check for empty frames first */
-		if (!have_line)
+		else if (i % (count_frames / progress_step) == 0)
 		{
-			if (is_empty(s_info, in_img))
-				continue;
-			else
-				checked_empty = 1;
+			fprintf(stderr, "\rProgress: %d/%d - Lines: %d", i - init_frame, count_frames, num_of_events);
 		}
 
-		/* Check for duplicate, unless first frame */
-		if ((i != init_frame) && have_line && is_identical(s_info, in_img, old_img))
+		/* Check for empty frames, and for duplicates while in a line. The
+		 * output image is prepared in the same pass, into the spare buffer,
+		 * as the current one may still be in use. */
+		frame_type = frame_funcs.classify(s_info, in_img, have_line ? old_img : NULL, next_buf->data, &(next_buf->bbox), dirty);
+		if ((!have_line && frame_type == FRAME_EMPTY) || frame_type == FRAME_IDENTICAL)
 			continue;
-		/* Mark frames that were not used as new image in comparison to have transparent pixels zeroed */
-		else if (!(i && have_line))
-			must_zero = 1;
 
-		/* Not a dup, write end-of-line, if we had a line before */
+		/* Not a dup, end line, if we had a line before */
 		if (have_line)
 		{
-			if (sup_output)
-			{
-				assert(pal != NULL);
-				write_sup_wrapper(sw, (uint8_t *)out_buf, n_crop, crops, pal, start_frame + to, i + to, split_at, min_split, stricter, mark_forced);
-				if (!xml_output)
-					free(pal);
-				pal = NULL;
-			}
-			if (xml_output)
-				add_event_xml(events, split_at, min_split, start_frame + to, i + to, n_crop, crops, mark_forced);
+			job->end = i;
+			job->closed = 1;
 			end_frame = i;
 			have_line = 0;
+			commit_events(&ctx, 0);
 		}
 
-		/* Check for empty frame, if we didn't before */
-		if (!checked_empty && is_empty(s_info, in_img))
+		/* Empty frame ends line, and fades have to follow their image */
+		if (frame_type == FRAME_EMPTY)
+		{
+			ctx.have_base = 0;
+			ctx.have_crops = 0;
 			continue;
-
-		/* Zero transparent pixels, if needed */
-		if (must_zero)
-			zero_transparent(s_info, in_img);
-		must_zero = 0;
+		}
 
 		/* Not an empty frame, start line */
 		have_line = 1;
 		start_frame = i;
-		swap_rb(s_info, in_img, out_buf);
-		if (buffer_opt)
-			n_crop = auto_split(pic, crops, ugly, even_y);
-		else if (autocrop)
-		{
-			crops[0].x = 0;
-			crops[0].y = 0;
-			crops[0].w = pic.w;
-			crops[0].h = pic.h;
-			auto_crop(pic, crops);
-		}
-		if ((buffer_opt || autocrop) && even_y)
-			enforce_even_y(crops, n_crop);
-		if ((pal_png || sup_output) && pal == NULL)
-			pal = palletize(out_buf, s_info->i_width, s_info->i_height);
-		if (xml_output)
-			for (j = 0; j < n_crop; j++)
-				write_png(png_dir, start_frame, (uint8_t *)out_buf, s_info->i_width, s_info->i_height, j, pal, crops[j]);
-		if (pal_png && xml_output && !sup_output)
+
+		/* Hand output image to a worker, unless it repeats an earlier one */
+		b = get_out_buf(&ctx);
+		job = start_event(&ctx, cache, next_buf, start_frame, dirty);
+		if (job->repeat)
 		{
-			free(pal);
-			pal = NULL;
+			b->next = ctx.free_bufs;
+			ctx.free_bufs = b;
 		}
+		else
+			next_buf = b;
 		num_of_events++;
 		if (first_frame == -1)
 			first_frame = i;
 
 		/* Save image for next comparison. */
-		tmp = in_img;
-		in_img = old_img;
-		old_img = tmp;
+		frame_reader_release(reader, old_img);
+		old_img = in_img;
+	}
+	close_frame_reader(reader);
+	close_dirty_map(dirty);
+
+	/* Length of streamed input is only known now */
+	if (frames < 0)
+	{
+		count_frames = i - init_frame;
+		frames = i;
 	}
 
 	fprintf(stderr, "\rProgress: %d/%d - Lines: %d - Done\n", i - init_frame, count_frames, num_of_events);
+	if (cache != NULL && cache->hits)
+		fprintf(stderr, "Repeated images: %d\n", cache->hits);
 
 	/* Add last event, if available */
 	if (have_line)
 	{
-		if (sup_output)
-		{
-			assert(pal != NULL);
-			write_sup_wrapper(sw, (uint8_t *)out_buf, n_crop, crops, pal, start_frame + to, i - 1 + to, split_at, min_split, stricter, mark_forced);
-			if (!xml_output)
-				free(pal);
-			pal = NULL;
-		}
-		if (xml_output)
-		{
-			add_event_xml(events, split_at, min_split, start_frame + to, i - 1 + to, n_crop, crops, mark_forced);
-			free(pal);
-			pal = NULL;
-		}
+		job->end = i - 1;
+		job->closed = 1;
 		auto_cut = 1;
 		end_frame = i - 1;
 	}
 
+	/* Commit remaining events */
+	while (ctx.head != NULL)
+		commit_events(&ctx, 1);
+	close_worker_pool(ctx.pool);
+	free(next_buf->raw);
+	free(next_buf);
+	free(ctx.fade_base);
+	while ((b = ctx.free_bufs) != NULL)
+	{
+		ctx.free_bufs = b->next;
+		free(b->raw);
+		free(b);
+	}
+
 	if (sup_output)
 	{
 		close_sup_writer(sw);
 	}
+	if (cache != NULL)
+		close_image_cache(cache);
 
 	if (xml_output)
 	{
@@ -389,7 +389,7 @@ void read_pcs_start (parser_state_t *ps, sup_header_t h)
 	safe_read(&pcss, sizeof(pcss), ps->fh, "PCSS structure");
 	conv_sup_pcs_start(&pcss);
 
-	if (pcss.m != 0)
+	if (pcss.m != 0 && pcss.m != 0x8000)
 		die(ps->fh, sizeof(pcss), "Invalid PCSS magic.");
 
 	printf("PCS start\n");
@@ -400,7 +400,9 @@ void read_pcs_start (parser_state_t *ps, sup_header_t h)
 		die(ps->fh, sizeof(pcss), "Invalid FPS ID in PCSS.");
 	printf("\tfps id       = %u (%u/%u)\n", pcss.fps_id, fps_num, fps_den);
 	printf("\tcomposition  = %u\n", pcss.comp_num);
-	printf("\tfollower     = 0x%02X (%s)\n", pcss.follower, pcss.follower == 0x80 ? "no" : "within 2f");
+	printf("\tfollower     = 0x%02X (%s)\n", pcss.follower, pcss.follower == 0x80 ? "no" : pcss.follower ? "within 2f" : "palette update");
+	if (pcss.m)
+		printf("\tpalette update\n");
 	printf("\tobjects      = %u\n", pcss.objects);
 
 	if (pcss.objects > 2)
@@ -0,0 +1,251 @@
+/*----------------------------------------------------------------------------
+ * pngbench - Compares PNG encoders on subtitle frames
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+/* Reads raw RGBA frames, as taken by avs2bdnxml on Linux, crops and
+ * palletizes each non-empty one like avs2bdnxml does, then encodes the crops
+ * with libpng and zlib at level 5 and with the built-in encoder at each of
+ * its levels. Prints time and total size per encoder. Built-in output is
+ * decoded again with libpng and checked against the input.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <png.h>
+#include "../auto_split.h"
+#include "../palletize.h"
+#include "../png_writer.h"
+
+#define ENCODERS (PNG_MAX_FAST_LEVEL + 2)
+#define RAW_MAGIC "RAWRGBA"
+#define RAW_ALIGN 64
+
+typedef struct mem_buf_s
+{
+	uint8_t *data;
+	size_t size;
+	size_t pos;
+} mem_buf_t;
+
+static void write_mem (png_structp png_ptr, png_bytep data, png_size_t len)
+{
+	mem_buf_t *m = png_get_io_ptr(png_ptr);
+
+	m->data = realloc(m->data, m->size + len);
+	memcpy(m->data + m->size, data, len);
+	m->size += len;
+}
+
+static void read_mem (png_structp png_ptr, png_bytep data, png_size_t len)
+{
+	mem_buf_t *m = png_get_io_ptr(png_ptr);
+
+	if (m->pos + len > m->size)
+		png_error(png_ptr, "Read past end of data");
+	memcpy(data, m->data + m->pos, len);
+	m->pos += len;
+}
+
+static void flush_mem (png_structp png_ptr)
+{
+}
+
+/* The libpng path of avs2bdnxml, writing to memory */
+static size_t encode_libpng (uint8_t *image, int w, uint32_t *pal, crop_t c)
+{
+	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	png_color palette[256];
+	png_byte trans[256];
+	png_bytep *rows = calloc(c.h, sizeof(png_bytep));
+	mem_buf_t m = {NULL, 0, 0};
+	char *col;
+	int colors = 1;
+	int i;
+
+	if (setjmp(png_jmpbuf(png_ptr)))
+	{
+		fprintf(stderr, "Error while writing PNG.\n");
+		exit(1);
+	}
+	png_set_write_fn(png_ptr, &m, write_mem, flush_mem);
+	png_set_IHDR(png_ptr, info_ptr, c.w, c.h, 8, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	memset(palette, 0, sizeof(palette));
+	memset(trans, 0, sizeof(trans));
+	for (i = 1; i < 256 && pal[i]; i++)
+	{
+		col = (char *)&(pal[i]);
+		palette[i].red = col[0];
+		palette[i].green = col[1];
+		palette[i].blue = col[2];
+		trans[i] = col[3];
+		colors++;
+	}
+	png_set_PLTE(png_ptr, info_ptr, palette, colors);
+	png_set_tRNS(png_ptr, info_ptr, trans, colors, NULL);
+	for (i = 0; i < c.h; i++)
+		rows[i] = image + c.x + w * (c.y + i);
+	png_set_rows(png_ptr, info_ptr, rows);
+	png_set_filter(png_ptr, 0, PNG_FILTER_VALUE_SUB);
+	png_set_compression_level(png_ptr, 5);
+	png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	free(rows);
+	free(m.data);
+
+	return m.size;
+}
+
+/* Decode png and compare its indices to area c of image */
+static int check_png (uint8_t *png, int size, uint8_t *image, int w, crop_t c)
+{
+	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	mem_buf_t m = {png, size, 0};
+	png_bytep *rows;
+	int ok = 1;
+	int i;
+
+	if (setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return 0;
+	}
+	png_set_read_fn(png_ptr, &m, read_mem);
+	png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+	if (png_get_image_width(png_ptr, info_ptr) != c.w || png_get_image_height(png_ptr, info_ptr) != c.h)
+		ok = 0;
+	rows = png_get_rows(png_ptr, info_ptr);
+	for (i = 0; ok && i < c.h; i++)
+		ok = !memcmp(rows[i], image + c.x + w * (c.y + i), c.w);
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+	return ok;
+}
+
+int main (int argc, char *argv[])
+{
+	FILE *fh;
+	char line[1024] = {0};
+	char *tok;
+	uint8_t *frame, *png;
+	uint32_t *pal;
+	double seconds[ENCODERS] = {0};
+	size_t bytes[ENCODERS] = {0};
+	clock_t t;
+	pic_t pic;
+	crop_t c;
+	int w = 1920, h = 1080;
+	int iterations = 1;
+	int offset = 0;
+	int frames = 0, images = 0;
+	int empty;
+	int size, i, k;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: pngbench input.raw [iterations]\n");
+		return 1;
+	}
+	if (argc > 2)
+		iterations = MAX(1, atoi(argv[2]));
+	if ((fh = fopen(argv[1], "rb")) == NULL)
+	{
+		perror("Cannot open input file");
+		return 1;
+	}
+
+	/* Optional header line */
+	if (fgets(line, sizeof(line), fh) != NULL && !strncmp(line, RAW_MAGIC, strlen(RAW_MAGIC)))
+	{
+		for (tok = strtok(line + strlen(RAW_MAGIC), " \n"); tok != NULL; tok = strtok(NULL, " \n"))
+		{
+			if (tok[0] == 'W')
+				w = atoi(tok + 1);
+			else if (tok[0] == 'H')
+				h = atoi(tok + 1);
+		}
+		offset = (ftell(fh) + RAW_ALIGN - 1) / RAW_ALIGN * RAW_ALIGN;
+	}
+	fseek(fh, offset, SEEK_SET);
+
+	frame = malloc(w * h * 4);
+	while (fread(frame, w * h * 4, 1, fh) == 1)
+	{
+		frames++;
+
+		/* Prepare like avs2bdnxml, skipping empty frames */
+		empty = 1;
+		for (i = 0; i < w * h; i++)
+			if (!frame[i * 4 + 3])
+				((uint32_t *)frame)[i] = 0;
+			else
+				empty = 0;
+		if (empty)
+			continue;
+		pic.b = (char *)frame;
+		pic.w = w;
+		pic.h = h;
+		pic.s = w;
+		c.x = 0;
+		c.y = 0;
+		c.w = w;
+		c.h = h;
+		auto_crop(pic, &c);
+		pal = palletize(frame, w, h, 1, &c);
+		images++;
+
+		for (k = 0; k < iterations; k++)
+		{
+			t = clock();
+			bytes[0] += encode_libpng(frame, w, pal, c);
+			seconds[0] += (double)(clock() - t) / CLOCKS_PER_SEC;
+
+			for (i = 0; i <= PNG_MAX_FAST_LEVEL; i++)
+			{
+				t = clock();
+				png = encode_png(frame, w, pal, c, i, &size);
+				seconds[i + 1] += (double)(clock() - t) / CLOCKS_PER_SEC;
+				bytes[i + 1] += size;
+				if (!k && !check_png(png, size, frame, w, c))
+				{
+					fprintf(stderr, "Error: Level %d output of frame %d does not match input.\n", i, frames - 1);
+					return 1;
+				}
+				free(png);
+			}
+		}
+		free(pal);
+	}
+	fclose(fh);
+
+	printf("Frames: %d, images: %d, iterations: %d\n", frames, images, iterations);
+	printf("%-16s %10s %12s %8s\n", "Encoder", "Seconds", "Bytes", "Speedup");
+	for (i = 0; i < ENCODERS; i++)
+	{
+		if (!i)
+			printf("%-16s", "libpng level 5");
+		else
+			printf("built-in level %d", i - 1);
+		printf(" %10.3f %12lu %7.1fx\n", seconds[i], (unsigned long)bytes[i], seconds[i] > 0 ? seconds[0] / seconds[i] : 0.0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+/* AVX2 row kernels for classify. This file has to be compiled with -mavx2,
+ * and is only called into after detect_cpu found CPU_AVX2. Eight pixels are
+ * handled at a time, the rest of a row is done in C, since rows need not be
+ * a multiple of 32 bytes and out must not be written past a row's end. */
+
+#include <stdint.h>
+#include <immintrin.h>
+#include "frame.h"
+
+static int scan_avx2 (uint32_t *im, uint32_t *old, int n, int *seen)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i a_mask = _mm256_set1_epi32(0xff000000);
+	__m256i p, q, t, u;
+	__m256i alpha = zero, diff = zero;
+	uint8_t *a = (uint8_t *)im, *b = (uint8_t *)old;
+	int tail_alpha = 0, tail_diff = 0;
+	int visible;
+	int i;
+
+	if (old == NULL)
+	{
+		for (i = 0; i + 8 <= n; i += 8)
+			alpha = _mm256_or_si256(alpha, _mm256_loadu_si256((__m256i *)(im + i)));
+		for (; i < n; i++)
+			tail_alpha |= a[i * 4 + 3];
+		visible = tail_alpha || !_mm256_testz_si256(alpha, a_mask);
+		*seen |= visible;
+		return visible;
+	}
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		p = _mm256_loadu_si256((__m256i *)(im + i));
+		q = _mm256_loadu_si256((__m256i *)(old + i));
+		t = _mm256_cmpeq_epi32(_mm256_and_si256(p, a_mask), zero);
+		u = _mm256_cmpeq_epi32(_mm256_and_si256(q, a_mask), zero);
+		alpha = _mm256_or_si256(alpha, p);
+		diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_andnot_si256(t, p), _mm256_andnot_si256(u, q)));
+	}
+	for (; i < n; i++)
+	{
+		tail_alpha |= a[i * 4 + 3];
+		tail_diff |= (a[i * 4 + 3] ? im[i] : 0) != (b[i * 4 + 3] ? old[i] : 0);
+	}
+	*seen |= tail_alpha || !_mm256_testz_si256(alpha, a_mask);
+
+	return tail_diff || !_mm256_testz_si256(diff, diff);
+}
+
+static int convert_avx2 (uint32_t *im, uint32_t *out, int n, int *last)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i a_mask = _mm256_set1_epi32(0xff000000);
+	__m256i shuf = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+	                                2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	__m256i p, t;
+	uint8_t *a = (uint8_t *)im;
+	int first = -1;
+	int i, m;
+
+	for (i = 0; i + 8 <= n; i += 8)
+	{
+		p = _mm256_loadu_si256((__m256i *)(im + i));
+		t = _mm256_cmpeq_epi32(_mm256_and_si256(p, a_mask), zero);
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_andnot_si256(t, _mm256_shuffle_epi8(p, shuf)));
+		if ((m = ~_mm256_movemask_ps(_mm256_castsi256_ps(t)) & 0xff))
+		{
+			if (first < 0)
+				first = i + __builtin_ctz(m);
+			*last = i + 31 - __builtin_clz(m);
+		}
+	}
+	for (; i < n; i++)
+	{
+		if (a[i * 4 + 3])
+		{
+			out[i] = (im[i] & 0xff00ff00) | ((im[i] >> 16) & 0xff) | ((im[i] & 0xff) << 16);
+			if (first < 0)
+				first = i;
+			*last = i;
+		}
+		else
+			out[i] = 0;
+	}
+
+	return first;
+}
+
+int classify_avx2 (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty)
+{
+	return classify_frame(s_info, img, img_old, out, bbox, dirty, scan_avx2, convert_avx2);
+}
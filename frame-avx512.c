@@ -0,0 +1,89 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+/* AVX-512BW row kernels for classify. This file has to be compiled
+ * with -mavx512f -mavx512bw, and is only called into after detect_cpu found
+ * CPU_AVX512BW. The final partial vector of a frame is handled with masked
+ * loads and stores, so nothing is read or written past its end. */
+
+#include <stdint.h>
+#include <immintrin.h>
+#include "frame.h"
+
+/* Mask for the n remaining pixels, with n < 16 */
+static inline __mmask16 tail_mask (int n)
+{
+	return (__mmask16)((1 << n) - 1);
+}
+
+static int scan_avx512 (uint32_t *im, uint32_t *old, int n, int *seen)
+{
+	__m512i a_mask = _mm512_set1_epi32(0xff000000);
+	__m512i p, q;
+	__mmask16 k, kp, kq, visible = 0;
+	int diff = 0;
+	int i;
+
+	for (i = 0; i < n; i += 16)
+	{
+		k = (n - i >= 16) ? 0xffff : tail_mask(n - i);
+		p = _mm512_maskz_loadu_epi32(k, im + i);
+		kp = _mm512_test_epi32_mask(p, a_mask);
+		visible |= kp;
+		if (old != NULL)
+		{
+			q = _mm512_maskz_loadu_epi32(k, old + i);
+			kq = _mm512_test_epi32_mask(q, a_mask);
+			diff |= _mm512_cmpneq_epi32_mask(_mm512_maskz_mov_epi32(kp, p), _mm512_maskz_mov_epi32(kq, q)) != 0;
+		}
+	}
+	*seen |= visible != 0;
+
+	return old != NULL ? diff : visible != 0;
+}
+
+static int convert_avx512 (uint32_t *im, uint32_t *out, int n, int *last)
+{
+	__m512i a_mask = _mm512_set1_epi32(0xff000000);
+	__m512i shuf = _mm512_broadcast_i32x4(_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+	__m512i p;
+	__mmask16 k, kp;
+	int first = -1;
+	int i;
+
+	for (i = 0; i < n; i += 16)
+	{
+		k = (n - i >= 16) ? 0xffff : tail_mask(n - i);
+		p = _mm512_maskz_loadu_epi32(k, im + i);
+		kp = _mm512_test_epi32_mask(p, a_mask);
+		_mm512_mask_storeu_epi32(out + i, k, _mm512_maskz_mov_epi32(kp, _mm512_shuffle_epi8(p, shuf)));
+		if (kp)
+		{
+			if (first < 0)
+				first = i + __builtin_ctz(kp);
+			*last = i + 31 - __builtin_clz(kp);
+		}
+	}
+
+	return first;
+}
+
+int classify_avx512 (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty)
+{
+	return classify_frame(s_info, img, img_old, out, bbox, dirty, scan_avx512, convert_avx512);
+}
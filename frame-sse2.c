@@ -0,0 +1,111 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+/* SSE2 row kernels for classify. This file has to be compiled with -msse2,
+ * and is only called into after detect_cpu found CPU_SSE2, so 32-bit builds
+ * still run on older CPUs. Four pixels are handled at a time, with unaligned
+ * loads and a scalar tail, since rows need not be a multiple of 16 bytes. */
+
+#include <stdint.h>
+#include <emmintrin.h>
+#include "frame.h"
+
+static int scan_sse2 (uint32_t *im, uint32_t *old, int n, int *seen)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i a_mask = _mm_set1_epi32(0xff000000);
+	__m128i p, q, t, u;
+	__m128i alpha = zero, diff = zero;
+	uint8_t *a = (uint8_t *)im, *b = (uint8_t *)old;
+	int tail_alpha = 0, tail_diff = 0;
+	int visible;
+	int i;
+
+	if (old == NULL)
+	{
+		for (i = 0; i + 4 <= n; i += 4)
+			alpha = _mm_or_si128(alpha, _mm_loadu_si128((__m128i *)(im + i)));
+		for (; i < n; i++)
+			tail_alpha |= a[i * 4 + 3];
+		visible = tail_alpha || _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(alpha, a_mask), zero)) != 0xffff;
+		*seen |= visible;
+		return visible;
+	}
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		p = _mm_loadu_si128((__m128i *)(im + i));
+		q = _mm_loadu_si128((__m128i *)(old + i));
+		t = _mm_cmpeq_epi32(_mm_and_si128(p, a_mask), zero);
+		u = _mm_cmpeq_epi32(_mm_and_si128(q, a_mask), zero);
+		alpha = _mm_or_si128(alpha, p);
+		diff = _mm_or_si128(diff, _mm_xor_si128(_mm_andnot_si128(t, p), _mm_andnot_si128(u, q)));
+	}
+	for (; i < n; i++)
+	{
+		tail_alpha |= a[i * 4 + 3];
+		tail_diff |= (a[i * 4 + 3] ? im[i] : 0) != (b[i * 4 + 3] ? old[i] : 0);
+	}
+	*seen |= tail_alpha || _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(alpha, a_mask), zero)) != 0xffff;
+
+	return tail_diff || _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xffff;
+}
+
+static int convert_sse2 (uint32_t *im, uint32_t *out, int n, int *last)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i a_mask = _mm_set1_epi32(0xff000000);
+	__m128i rb_mask = _mm_set1_epi32(0x00ff00ff);
+	__m128i p, q, t;
+	uint8_t *a = (uint8_t *)im;
+	int first = -1;
+	int i, m;
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		p = _mm_loadu_si128((__m128i *)(im + i));
+		t = _mm_cmpeq_epi32(_mm_and_si128(p, a_mask), zero);
+		q = _mm_or_si128(_mm_and_si128(_mm_or_si128(_mm_srli_epi32(p, 16), _mm_slli_epi32(p, 16)), rb_mask), _mm_andnot_si128(rb_mask, p));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_andnot_si128(t, q));
+		if ((m = ~_mm_movemask_ps(_mm_castsi128_ps(t)) & 0xf))
+		{
+			if (first < 0)
+				first = i + __builtin_ctz(m);
+			*last = i + 31 - __builtin_clz(m);
+		}
+	}
+	for (; i < n; i++)
+	{
+		if (a[i * 4 + 3])
+		{
+			out[i] = (im[i] & 0xff00ff00) | ((im[i] >> 16) & 0xff) | ((im[i] & 0xff) << 16);
+			if (first < 0)
+				first = i;
+			*last = i;
+		}
+		else
+			out[i] = 0;
+	}
+
+	return first;
+}
+
+int classify_sse2 (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty)
+{
+	return classify_frame(s_info, img, img_old, out, bbox, dirty, scan_sse2, convert_sse2);
+}
@@ -0,0 +1,381 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "frame.h"
+
+frame_funcs_t frame_funcs;
+
+#ifdef HAVE_SSE2
+/* Compiler intrinsics, see frame-sse2.c */
+extern int classify_sse2 (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty);
+#endif
+#ifdef HAVE_AVX2
+/* Compiler intrinsics, see frame-avx2.c */
+extern int classify_avx2 (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty);
+#endif
+#ifdef HAVE_AVX512
+/* Compiler intrinsics, see frame-avx512.c */
+extern int classify_avx512 (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty);
+#endif
+
+dirty_map_t *new_dirty_map (int w, int h)
+{
+	dirty_map_t *d = calloc(1, sizeof(dirty_map_t));
+
+	d->tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+	d->tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
+	d->tiles = calloc(d->tiles_x * d->tiles_y, sizeof(uint8_t));
+	if (d->tiles == NULL)
+	{
+		fprintf(stderr, "Error: Cannot allocate dirty map.\n");
+		exit(1);
+	}
+
+	return d;
+}
+
+void close_dirty_map (dirty_map_t *d)
+{
+	free(d->tiles);
+	free(d);
+}
+
+int is_dirty (dirty_map_t *d, crop_t c)
+{
+	int tx, ty;
+
+	if (c.w <= 0 || c.h <= 0)
+		return 0;
+	for (ty = c.y / TILE_SIZE; ty <= (c.y + c.h - 1) / TILE_SIZE && ty < d->tiles_y; ty++)
+		for (tx = c.x / TILE_SIZE; tx <= (c.x + c.w - 1) / TILE_SIZE && tx < d->tiles_x; tx++)
+			if (d->tiles[tx + ty * d->tiles_x])
+				return 1;
+
+	return 0;
+}
+
+int fade_scale (char *base, char *img, int w, crop_t c)
+{
+	uint8_t *b, *n;
+	uint64_t sum_b = 0, sum_n = 0;
+	uint32_t k;
+	int a;
+	int x, y;
+
+	/* Colors have to match wherever img is visible, nothing may appear */
+	for (y = c.y; y < c.y + c.h; y++)
+	{
+		b = (uint8_t *)base + (c.x + y * w) * 4;
+		n = (uint8_t *)img + (c.x + y * w) * 4;
+		for (x = 0; x < c.w; x++, b += 4, n += 4)
+		{
+			if (!n[3])
+				continue;
+			if (!b[3] || b[0] != n[0] || b[1] != n[1] || b[2] != n[2])
+				return 0;
+			sum_b += b[3];
+			sum_n += n[3];
+		}
+	}
+	if (!sum_n)
+		return 0;
+	k = (sum_n << 16) / sum_b;
+
+	/* Alpha has to follow within rounding, also where img became invisible */
+	for (y = c.y; y < c.y + c.h; y++)
+	{
+		b = (uint8_t *)base + (c.x + y * w) * 4;
+		n = (uint8_t *)img + (c.x + y * w) * 4;
+		for (x = 0; x < c.w; x++, b += 4, n += 4)
+		{
+			a = (b[3] * k + 32768) >> 16; /* k is at most 255 << 16 */
+			if (a - n[3] > 1 || n[3] - a > 1)
+				return 0;
+		}
+	}
+
+	return k;
+}
+
+/* Count changed tiles and find their bounding box */
+static void finish_dirty_map (dirty_map_t *d, int w, int h)
+{
+	int tx0 = INT_MAX, tx1 = -1, ty0 = -1, ty1 = -1;
+	int tx, ty;
+
+	d->n_dirty = 0;
+	for (ty = 0; ty < d->tiles_y; ty++)
+		for (tx = 0; tx < d->tiles_x; tx++)
+			if (d->tiles[tx + ty * d->tiles_x])
+			{
+				d->n_dirty++;
+				tx0 = MIN(tx0, tx);
+				tx1 = MAX(tx1, tx);
+				if (ty0 < 0)
+					ty0 = ty;
+				ty1 = ty;
+			}
+
+	if (!d->n_dirty)
+	{
+		d->bbox.x = 0;
+		d->bbox.y = 0;
+		d->bbox.w = 0;
+		d->bbox.h = 0;
+		return;
+	}
+	d->bbox.x = tx0 * TILE_SIZE;
+	d->bbox.y = ty0 * TILE_SIZE;
+	d->bbox.w = MIN((tx1 + 1) * TILE_SIZE, w) - d->bbox.x;
+	d->bbox.h = MIN((ty1 + 1) * TILE_SIZE, h) - d->bbox.y;
+}
+
+/* Rows are first scanned for differences and alpha, in tile wide segments.
+ * Only rows with visible pixels are then converted, while they are still in
+ * cache. Other rows of out are cleared, if they were inside the old bounding
+ * box. Once the frame is known to differ, only segments of tiles not yet
+ * marked dirty are still compared. */
+int classify_frame (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty, row_scan_func_t scan, row_convert_func_t convert)
+{
+	int w = s_info->i_width, h = s_info->i_height;
+	int old_y0 = bbox->h ? bbox->y : 0, old_y1 = bbox->h ? bbox->y + bbox->h : 0;
+	int x0 = INT_MAX, x1 = -1, y0 = -1, y1 = -1;
+	int identical = img_old != NULL;
+	uint8_t *tiles = NULL;
+	uint32_t *im, *im_old = NULL, *o;
+	int seen, first, last = -1;
+	int x, y, t;
+
+	if (dirty != NULL)
+		memset(dirty->tiles, 0, dirty->tiles_x * dirty->tiles_y);
+
+	for (y = 0; y < h; y++)
+	{
+		im = (uint32_t *)img + y * w;
+		if (img_old != NULL)
+			im_old = (uint32_t *)img_old + y * w;
+		if (dirty != NULL)
+			tiles = dirty->tiles + (y / TILE_SIZE) * dirty->tiles_x;
+		seen = 0;
+		for (x = 0, t = 0; x < w; x += TILE_SIZE, t++)
+		{
+			if (img_old != NULL && (identical || (tiles != NULL && !tiles[t])))
+			{
+				if (scan(im + x, im_old + x, MIN(TILE_SIZE, w - x), &seen))
+				{
+					identical = 0;
+					if (tiles != NULL)
+						tiles[t] = 1;
+				}
+			}
+			else if (scan(im + x, NULL, MIN(TILE_SIZE, w - x), &seen) && tiles != NULL && img_old == NULL)
+				tiles[t] = 1;
+		}
+
+		o = (uint32_t *)out + y * w;
+		if (seen)
+		{
+			first = convert(im, o, w, &last);
+			x0 = MIN(x0, first);
+			x1 = MAX(x1, last);
+			if (y0 < 0)
+				y0 = y;
+			y1 = y;
+		}
+		else if (y >= old_y0 && y < old_y1)
+			memset(o, 0, w * 4);
+	}
+
+	if (dirty != NULL)
+		finish_dirty_map(dirty, w, h);
+
+	if (y0 < 0)
+	{
+		bbox->x = 0;
+		bbox->y = 0;
+		bbox->w = 0;
+		bbox->h = 0;
+	}
+	else
+	{
+		bbox->x = x0;
+		bbox->y = y0;
+		bbox->w = x1 - x0 + 1;
+		bbox->h = y1 - y0 + 1;
+	}
+
+	if (identical)
+		return FRAME_IDENTICAL;
+	return y0 < 0 ? FRAME_EMPTY : FRAME_CHANGED;
+}
+
+static int scan_c (uint32_t *im, uint32_t *old, int n, int *seen)
+{
+	uint8_t *a = (uint8_t *)im, *b = (uint8_t *)old;
+	uint32_t diff = 0;
+	int alpha = 0;
+	int i;
+
+	if (old == NULL)
+	{
+		for (i = 0; i < n; i++)
+			alpha |= a[i * 4 + 3];
+		*seen |= alpha;
+		return alpha != 0;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		alpha |= a[i * 4 + 3];
+		diff |= (a[i * 4 + 3] ? im[i] : 0) ^ (b[i * 4 + 3] ? old[i] : 0);
+	}
+	*seen |= alpha;
+
+	return diff != 0;
+}
+
+static int convert_c (uint32_t *im, uint32_t *out, int n, int *last)
+{
+	uint8_t *a = (uint8_t *)im, *o = (uint8_t *)out;
+	int first = -1;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (a[i * 4 + 3])
+		{
+			o[i * 4 + 0] = a[i * 4 + 2];
+			o[i * 4 + 1] = a[i * 4 + 1];
+			o[i * 4 + 2] = a[i * 4 + 0];
+			o[i * 4 + 3] = a[i * 4 + 3];
+			if (first < 0)
+				first = i;
+			*last = i;
+		}
+		else
+			out[i] = 0;
+	}
+
+	return first;
+}
+
+static int classify_c (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty)
+{
+	return classify_frame(s_info, img, img_old, out, bbox, dirty, scan_c, convert_c);
+}
+
+static void cpuid (unsigned int func, unsigned int sub, unsigned int *eax, unsigned int *ebx, unsigned int *ecx, unsigned int *edx)
+{
+	asm volatile
+	(
+		"cpuid\n"
+		: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+		: "a" (func), "c" (sub)
+	);
+}
+
+/* Register state the OS saves on context switches */
+static unsigned int xgetbv ()
+{
+	unsigned int eax, edx;
+
+	asm volatile
+	(
+		".byte 0x0f, 0x01, 0xd0\n" /* xgetbv, unknown to older assemblers */
+		: "=a" (eax), "=d" (edx)
+		: "c" (0)
+	);
+
+	return eax;
+}
+
+int detect_cpu ()
+{
+	static int detection = -1;
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int max_func, xcr0 = 0;
+
+	if (detection != -1)
+		return detection;
+	detection = 0;
+
+	cpuid(0, 0, &max_func, &ebx, &ecx, &edx);
+	if (max_func < 1)
+		return detection;
+
+	/* SSE2:    leaf 1 edx & 0x04000000
+	 * OSXSAVE: leaf 1 ecx & 0x08000000
+	 * AVX:     leaf 1 ecx & 0x10000000
+	 */
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (edx & 0x04000000)
+		detection |= CPU_SSE2;
+	if ((ecx & 0x18000000) == 0x18000000)
+		xcr0 = xgetbv();
+
+	/* AVX2:     leaf 7 ebx & 0x00000020, with ymm state enabled
+	 * AVX512F:  leaf 7 ebx & 0x00010000, with zmm and mask state enabled
+	 * AVX512BW: leaf 7 ebx & 0x40000000
+	 */
+	if (max_func >= 7 && (xcr0 & 0x06) == 0x06)
+	{
+		cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+		if (ebx & 0x00000020)
+			detection |= CPU_AVX2;
+		if ((ebx & 0x40010000) == 0x40010000 && (xcr0 & 0xe6) == 0xe6)
+			detection |= CPU_AVX512BW;
+	}
+
+	return detection;
+}
+
+void init_frame_funcs ()
+{
+	int cpu = detect_cpu();
+	char *name = "pure C";
+
+	frame_funcs.classify = classify_c;
+#ifdef HAVE_SSE2
+	if (cpu & CPU_SSE2)
+	{
+		name = "SSE2 optimized";
+		frame_funcs.classify = classify_sse2;
+	}
+#endif
+#ifdef HAVE_AVX2
+	if (cpu & CPU_AVX2)
+	{
+		name = "AVX2 optimized";
+		frame_funcs.classify = classify_avx2;
+	}
+#endif
+#ifdef HAVE_AVX512
+	if (cpu & CPU_AVX512BW)
+	{
+		name = "AVX-512BW optimized";
+		frame_funcs.classify = classify_avx512;
+	}
+#endif
+
+	fprintf(stderr, "CPU: Using %s functions.\n", name);
+}
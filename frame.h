@@ -0,0 +1,105 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include "auto_split.h"
+
+/* Frame buffers are aligned to and padded by at least this many bytes, so
+ * the widest kernels may read and write past the end of a frame. */
+#define FRAME_ALIGN 64
+#define FRAME_PADDING (2 * FRAME_ALIGN)
+
+typedef struct {
+    int i_width;
+    int i_height;
+    int i_fps_den;
+    int i_fps_num;
+} stream_info_t;
+
+#define CPU_SSE2     0x0001
+#define CPU_AVX2     0x0002
+#define CPU_AVX512BW 0x0004
+
+/* Results of classify */
+#define FRAME_CHANGED   0
+#define FRAME_EMPTY     1
+#define FRAME_IDENTICAL 2
+
+/* Frames are split into tiles of TILE_SIZE x TILE_SIZE pixels for tracking
+ * changes between them */
+#define TILE_SIZE 64
+
+typedef struct dirty_map_s
+{
+	int tiles_x;
+	int tiles_y;
+	int n_dirty;    /* Number of changed tiles */
+	crop_t bbox;    /* Bounding box of changed tiles in pixels, clipped to the frame */
+	uint8_t *tiles; /* One flag per tile, row by row */
+} dirty_map_t;
+
+typedef struct frame_funcs_s
+{
+	/* Compares img to img_old, ignoring colors of transparent pixels, unless
+	 * img_old is NULL, and writes the R/B swapped copy of img with transparent pixels
+	 * zeroed to out. On entry, bbox holds the bounding box of non-zero pixels
+	 * in out, rows outside of it are not written to unless needed. On return,
+	 * it holds the bounding box of non-transparent pixels in img. If dirty is
+	 * not NULL, tiles which differ from img_old, or which have visible pixels
+	 * if img_old is NULL, are marked in it. Returns FRAME_IDENTICAL,
+	 * FRAME_EMPTY or FRAME_CHANGED. */
+	int (*classify) (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty);
+} frame_funcs_t;
+
+/* Filled by init_frame_funcs */
+extern frame_funcs_t frame_funcs;
+
+/* Returns supported CPU_* flags */
+int detect_cpu ();
+
+/* Row kernels for classify_frame. A scan function returns non-zero, if the
+ * n pixels of im differ from those of old, or if old is NULL, if any of them
+ * is visible. It sets *seen, if any is visible. A convert function writes
+ * the n pixels of im to out like classify, and returns the index of the
+ * first visible one, or -1, setting *last to the last one. */
+typedef int (*row_scan_func_t) (uint32_t *im, uint32_t *old, int n, int *seen);
+typedef int (*row_convert_func_t) (uint32_t *im, uint32_t *out, int n, int *last);
+
+/* Implements classify with the given row kernels */
+int classify_frame (stream_info_t *s_info, char *img, char *img_old, char *out, crop_t *bbox, dirty_map_t *dirty, row_scan_func_t scan, row_convert_func_t convert);
+
+dirty_map_t *new_dirty_map (int w, int h);
+void close_dirty_map (dirty_map_t *d);
+
+/* Returns 1, if any tile overlapping c was marked as changed */
+int is_dirty (dirty_map_t *d, crop_t c);
+
+/* Returns the factor, in 16.16 fixed point, by which alpha of all pixels of
+ * base was scaled to get img, if colors are otherwise the same and alpha is
+ * off by at most one. Returns 0, if img is no such fade of base. Both are laid
+ * out like the output of classify, and zero outside of area c. */
+int fade_scale (char *base, char *img, int w, crop_t c);
+
+/* Select fastest kernels once, before any frame is processed */
+void init_frame_funcs ();
+
+#endif
+
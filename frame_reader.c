@@ -0,0 +1,202 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "frame.h"
+#include "frame_reader.h"
+
+/* Reader thread. Fills free buffers in frame order, until all frames were
+ * read, a read fails or the reader is closed.
+ */
+static void *read_frames (void *arg)
+{
+	frame_reader_t *fr = arg;
+	char *buf;
+	int frame;
+	int r;
+
+	pthread_mutex_lock(&fr->lock);
+	while (!fr->done && fr->next < fr->last)
+	{
+		while (!fr->n_free && !fr->done)
+			pthread_cond_wait(&fr->cond, &fr->lock);
+		if (fr->done)
+			break;
+		buf = fr->free[--(fr->n_free)];
+		frame = (fr->next)++;
+		pthread_mutex_unlock(&fr->lock);
+
+		r = fr->read(buf, fr->handle, frame);
+
+		pthread_mutex_lock(&fr->lock);
+		if (r)
+		{
+			fr->error = r < 0;
+			fr->free[(fr->n_free)++] = buf;
+			break;
+		}
+		fr->ready[(fr->ready_pos + (fr->n_ready)++) % fr->n_buf] = buf;
+		pthread_cond_broadcast(&fr->cond);
+	}
+	fr->done = 1;
+	pthread_cond_broadcast(&fr->cond);
+	pthread_mutex_unlock(&fr->lock);
+
+	return NULL;
+}
+
+frame_reader_t *new_frame_reader (frame_read_func_t read, frame_map_func_t map, void *handle, int size, int first, int last, int read_ahead)
+{
+	frame_reader_t *fr = calloc(1, sizeof(frame_reader_t));
+	int i;
+
+	fr->read = read;
+	fr->map = map;
+	fr->handle = handle;
+	fr->threaded = read_ahead > 0;
+	fr->next = first;
+	fr->last = last;
+
+	/* Zero-copy input needs no buffers */
+	if (map != NULL && first < last && map(handle, first) != NULL)
+	{
+		fr->mapped = 1;
+		fr->threaded = 0;
+		return fr;
+	}
+
+	/* Read ahead frames, plus the one being processed and the one kept for
+	 * comparison.
+	 */
+	fr->n_buf = read_ahead + 2;
+	fr->raw = calloc(fr->n_buf, sizeof(char *));
+	fr->free = calloc(fr->n_buf, sizeof(char *));
+	fr->ready = calloc(fr->n_buf, sizeof(char *));
+	for (i = 0; i < fr->n_buf; i++)
+	{
+		fr->raw[i] = calloc(size + FRAME_ALIGN + FRAME_PADDING, sizeof(char)); /* allocate + FRAME_ALIGN for alignment, and + FRAME_PADDING for over read/write */
+		if (fr->raw[i] == NULL)
+		{
+			fprintf(stderr, "Error: Cannot allocate frame buffers.\n");
+			exit(1);
+		}
+		fr->free[fr->n_free++] = fr->raw[i] + (short)(FRAME_ALIGN - ((long)fr->raw[i] % FRAME_ALIGN));
+	}
+
+	pthread_mutex_init(&fr->lock, NULL);
+	pthread_cond_init(&fr->cond, NULL);
+
+	if (fr->threaded && pthread_create(&fr->thread, NULL, read_frames, fr))
+	{
+		fprintf(stderr, "Warning: Cannot start reader thread, reading synchronously.\n");
+		fr->threaded = 0;
+	}
+
+	return fr;
+}
+
+char *frame_reader_get (frame_reader_t *fr)
+{
+	char *buf = NULL;
+	int r;
+
+	if (fr->mapped)
+	{
+		if (fr->done || fr->next >= fr->last)
+			return NULL;
+		if ((buf = fr->map(fr->handle, (fr->next)++)) == NULL)
+			fr->done = 1;
+		return buf;
+	}
+
+	if (!fr->threaded)
+	{
+		if (fr->done || fr->next >= fr->last || !fr->n_free)
+			return NULL;
+		buf = fr->free[--(fr->n_free)];
+		if ((r = fr->read(buf, fr->handle, (fr->next)++)))
+		{
+			fr->error = r < 0;
+			fr->done = 1;
+			fr->free[(fr->n_free)++] = buf;
+			return NULL;
+		}
+		return buf;
+	}
+
+	pthread_mutex_lock(&fr->lock);
+	while (!fr->n_ready && !fr->done)
+		pthread_cond_wait(&fr->cond, &fr->lock);
+	if (fr->n_ready)
+	{
+		buf = fr->ready[fr->ready_pos];
+		fr->ready_pos = (fr->ready_pos + 1) % fr->n_buf;
+		(fr->n_ready)--;
+	}
+	pthread_mutex_unlock(&fr->lock);
+
+	return buf;
+}
+
+void frame_reader_release (frame_reader_t *fr, char *buf)
+{
+	if (buf == NULL || fr->mapped)
+		return;
+
+	if (fr->threaded)
+		pthread_mutex_lock(&fr->lock);
+	fr->free[(fr->n_free)++] = buf;
+	if (fr->threaded)
+	{
+		pthread_cond_broadcast(&fr->cond);
+		pthread_mutex_unlock(&fr->lock);
+	}
+}
+
+void close_frame_reader (frame_reader_t *fr)
+{
+	int i;
+
+	if (fr->mapped)
+	{
+		free(fr);
+		return;
+	}
+
+	if (fr->threaded)
+	{
+		pthread_mutex_lock(&fr->lock);
+		fr->done = 1;
+		pthread_cond_broadcast(&fr->cond);
+		pthread_mutex_unlock(&fr->lock);
+		pthread_join(fr->thread, NULL);
+	}
+	pthread_cond_destroy(&fr->cond);
+	pthread_mutex_destroy(&fr->lock);
+
+	for (i = 0; i < fr->n_buf; i++)
+		free(fr->raw[i]);
+	free(fr->raw);
+	free(fr->free);
+	free(fr->ready);
+	free(fr);
+}
+
@@ -0,0 +1,74 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef FRAME_READER_H
+#define FRAME_READER_H
+
+#include <pthread.h>
+
+/* Reads frame number frame into buf. Returns 0 on success, 1 at the end of
+ * input and -1 on error. */
+typedef int (*frame_read_func_t)(char *buf, void *handle, int frame);
+
+/* Returns a pointer to frame number frame, if the input can provide frames
+ * without copying them. Returns NULL otherwise. */
+typedef char *(*frame_map_func_t)(void *handle, int frame);
+
+typedef struct frame_reader_s
+{
+	frame_read_func_t read;
+	frame_map_func_t map;
+	void *handle;
+	int mapped;    /* Frames are handed out directly by map */
+	int threaded;
+	int error;
+	int done;
+	int next;      /* Next frame number to be read */
+	int last;      /* One past the last frame number to be read */
+	int n_buf;
+	char **raw;    /* Unaligned allocations */
+	char **free;   /* Stack of unused buffers */
+	int n_free;
+	char **ready;  /* Ring of read buffers, in frame order */
+	int ready_pos;
+	int n_ready;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} frame_reader_t;
+
+/* Start reading frames first to last - 1 into a ring of FRAME_ALIGN byte
+ * aligned buffers of size bytes each. Up to read_ahead frames are read in a separate
+ * thread. If read_ahead is 0, frames are read synchronously on request.
+ * If map is not NULL and returns a frame, frames are not copied at all and
+ * neither thread nor buffers are used. Frames must not be written to.
+ */
+frame_reader_t *new_frame_reader (frame_read_func_t read, frame_map_func_t map, void *handle, int size, int first, int last, int read_ahead);
+
+/* Get next frame in order. Returns NULL at the end of input or on read error,
+ * in which case error is set. */
+char *frame_reader_get (frame_reader_t *fr);
+
+/* Hand a buffer obtained from frame_reader_get back for reuse */
+void frame_reader_release (frame_reader_t *fr, char *buf);
+
+/* Stop reader thread and free all buffers */
+void close_frame_reader (frame_reader_t *fr);
+
+#endif
+
@@ -0,0 +1,146 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "image_cache.h"
+
+#define PRIME1 0x9e3779b185ebca87ULL
+#define PRIME2 0xc2b2ae3d27d4eb4fULL
+#define PRIME3 0x165667b19e3779f9ULL
+#define PRIME4 0x27d4eb2f165667c5ULL
+
+image_cache_t *new_image_cache ()
+{
+	image_cache_t *ic = calloc(1, sizeof(image_cache_t));
+
+	ic->entries = calloc(IMAGE_CACHE_SIZE, sizeof(image_cache_entry_t *));
+	if (ic->entries == NULL)
+	{
+		fprintf(stderr, "Error: Cannot allocate image cache.\n");
+		exit(1);
+	}
+
+	return ic;
+}
+
+void close_image_cache (image_cache_t *ic)
+{
+	int i;
+
+	for (i = 0; i < IMAGE_CACHE_SIZE; i++)
+		if (ic->entries[i] != NULL)
+			image_cache_release(ic->entries[i]);
+	free(ic->entries);
+	free(ic);
+}
+
+static inline uint64_t rotl64 (uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix (uint64_t h, uint64_t v)
+{
+	h ^= rotl64(v * PRIME2, 31) * PRIME1;
+	return rotl64(h, 27) * PRIME1 + PRIME2;
+}
+
+/* Different constants and rotations, for the check hash */
+static inline uint64_t mix_check (uint64_t h, uint64_t v)
+{
+	h ^= rotl64(v * PRIME4, 29) * PRIME3;
+	return rotl64(h, 23) * PRIME3 + PRIME4;
+}
+
+static inline uint64_t avalanche (uint64_t h)
+{
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+
+	return h;
+}
+
+void hash_image (uint8_t *im, int w, int h, crop_t bbox, image_key_t *key)
+{
+	uint64_t pos = ((uint64_t)bbox.x << 32) | bbox.y, size = ((uint64_t)bbox.w << 32) | bbox.h;
+	uint64_t hash = mix(mix(0, pos), size);
+	uint64_t check = mix_check(mix_check(PRIME1, size), pos);
+	uint64_t v;
+	uint8_t *row;
+	int n, x, y;
+
+	for (y = bbox.y; y < bbox.y + bbox.h && y < h; y++)
+	{
+		row = im + (bbox.x + y * w) * 4;
+		n = bbox.w * 4;
+		for (x = 0; x + 8 <= n; x += 8)
+		{
+			memcpy(&v, row + x, 8);
+			hash = mix(hash, v);
+			check = mix_check(check, v);
+		}
+		if (x < n)
+		{
+			v = 0;
+			memcpy(&v, row + x, n - x);
+			hash = mix(hash, v);
+			check = mix_check(check, v);
+		}
+	}
+
+	key->hash = avalanche(hash);
+	key->check = avalanche(check);
+	key->bbox = bbox;
+}
+
+image_cache_entry_t *image_cache_find (image_cache_t *ic, image_key_t *key)
+{
+	image_cache_entry_t *e = ic->entries[key->hash & (IMAGE_CACHE_SIZE - 1)];
+
+	if (e == NULL || e->key.hash != key->hash || e->key.check != key->check || memcmp(&(e->key.bbox), &(key->bbox), sizeof(crop_t)))
+		return NULL;
+	ic->hits++;
+	e->refs++;
+
+	return e;
+}
+
+image_cache_entry_t *image_cache_insert (image_cache_t *ic, image_key_t *key)
+{
+	image_cache_entry_t **slot = &(ic->entries[key->hash & (IMAGE_CACHE_SIZE - 1)]);
+
+	if (*slot != NULL)
+		image_cache_release(*slot);
+	*slot = calloc(1, sizeof(image_cache_entry_t));
+	(*slot)->key = *key;
+	(*slot)->refs = 2;
+
+	return *slot;
+}
+
+void image_cache_release (image_cache_entry_t *e)
+{
+	if (--(e->refs))
+		return;
+	free_sup_rle(&(e->rle));
+	free(e);
+}
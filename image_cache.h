@@ -0,0 +1,79 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdint.h>
+#include "auto_split.h"
+#include "sup.h"
+
+/* Number of slots, must be a power of two. A new image replaces the one in
+ * its slot. */
+#define IMAGE_CACHE_SIZE 1024
+
+/* Everything produced for an event image, which is needed to repeat it.
+ * Entries are reference counted, as events repeating them may still be in
+ * flight after they were replaced in the cache. The data is filled in by
+ * whoever processes the event first. */
+/* Identifies an image. A hit needs both hashes and the bounding box to match,
+ * so a collision of one hash does not reuse the wrong image. */
+typedef struct image_key_s
+{
+	uint64_t hash;
+	uint64_t check; /* Second, independently mixed hash */
+	crop_t bbox;
+} image_key_t;
+
+typedef struct image_cache_entry_s
+{
+	image_key_t key;
+	int refs;
+	int image;         /* File number of written PNGs */
+	int num_crop;
+	crop_t crops[2];
+	uint32_t pal[256];
+	int have_pal;
+	sup_rle_t rle;
+} image_cache_entry_t;
+
+typedef struct image_cache_s
+{
+	image_cache_entry_t **entries;
+	int hits;
+} image_cache_t;
+
+image_cache_t *new_image_cache ();
+void close_image_cache (image_cache_t *ic);
+
+/* Key of the w x h image im, restricted to bbox, which everything outside of
+ * is zero. Both 64-bit hashes are taken in a single pass, and include the
+ * position of bbox. */
+void hash_image (uint8_t *im, int w, int h, crop_t bbox, image_key_t *key);
+
+/* Returns the entry for key with a reference taken, or NULL */
+image_cache_entry_t *image_cache_find (image_cache_t *ic, image_key_t *key);
+
+/* Returns a new entry for key with a reference taken, replacing whatever was
+ * in its slot */
+image_cache_entry_t *image_cache_insert (image_cache_t *ic, image_key_t *key);
+
+/* Drop a reference to e */
+void image_cache_release (image_cache_entry_t *e);
+
+#endif
@@ -19,86 +19,145 @@
  *----------------------------------------------------------------------------*/
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <stdint.h>
-#include "abstract_lists.h"
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "palletize.h"
+
+#ifndef DEBUG
+#define DEBUG 0
+#endif
 
 #define LEVELS 5
 #define COLORS 254 /* One reserved for 100% transparent */
+#define ARENA_BLOCK 4096 /* Nodes per arena block */
+#define ARENA_KEEP 8     /* Blocks kept between images */
+#define EXACT_BITS 9     /* Slots of the exact color table, as power of 2 */
+#define CACHE_BITS 10    /* Entries of the color index cache, as power of 2 */
 
 typedef struct hexnode_s hexnode_t;
 struct hexnode_s
 {
 	unsigned int v[4]; 
 	hexnode_t *nodes[16];
+	hexnode_t *prev; /* Nodes of the same level, newest first */
+	hexnode_t *next;
 	int children;
 	int leaf;
 	int count;
 	int index;
 };
 
-static hexnode_t *new_hexnode ()
+/* Nodes are taken from blocks, which are kept for the next image */
+typedef struct node_arena_s
 {
-	hexnode_t *n = calloc(1, sizeof(hexnode_t));
-	int i;
+	hexnode_t **blocks;
+	int n_blocks;
+	int used;
+} node_arena_t;
+
+/* Direct mapped cache in front of get_color_index. The empty entry maps
+ * color 0 to index 0, which is right. */
+typedef struct index_cache_s
+{
+	uint32_t colors[1 << CACHE_BITS];
+	uint8_t indices[1 << CACHE_BITS];
+} index_cache_t;
+
+typedef struct quantizer_s
+{
+	hexnode_t *root;
+	hexnode_t *levels[LEVELS + 1];
+	int colors;
+	int nodes;
+	node_arena_t arena;
+	index_cache_t cache;
+} quantizer_t;
+
+static pthread_key_t quantizer_key;
+static pthread_once_t quantizer_once = PTHREAD_ONCE_INIT;
+
+static hexnode_t *new_hexnode (quantizer_t *q)
+{
+	node_arena_t *a = &(q->arena);
+	hexnode_t *n;
 
-	for (i = 0; i < 4; i++)
+	if (a->used == a->n_blocks * ARENA_BLOCK)
 	{
-		n->v[i] = 0;
-		n->nodes[i] = NULL;
+		a->blocks = realloc(a->blocks, (a->n_blocks + 1) * sizeof(hexnode_t *));
+		if (a->blocks == NULL || (a->blocks[a->n_blocks] = malloc(ARENA_BLOCK * sizeof(hexnode_t))) == NULL)
+		{
+			fprintf(stderr, "Error: Cannot allocate palette nodes.\n");
+			exit(1);
+		}
+		a->n_blocks++;
 	}
-	for (i = 4; i < 16; i++)
-		n->nodes[i] = NULL;
-	n->children = 0;
-	n->leaf = 0;
-	n->count = 0;
-	n->index = 0;
+	n = &(a->blocks[a->used / ARENA_BLOCK][a->used % ARENA_BLOCK]);
+	a->used++;
+	memset(n, 0, sizeof(hexnode_t));
 
 	return n;
 }
 
-static void tree_destroy (hexnode_t *n)
+static void level_insert (quantizer_t *q, int level, hexnode_t *n)
 {
-	int i;
-
-	for (i = 0; i < 16; i++)
-		if (n->nodes[i] != NULL)
-			tree_destroy(n->nodes[i]);
-
-	free(n);
+	n->prev = NULL;
+	n->next = q->levels[level];
+	if (n->next != NULL)
+		n->next->prev = n;
+	q->levels[level] = n;
 }
 
-STATIC_LIST(pal, hexnode_t)
-
-typedef struct quantizer_s
+static void level_remove (quantizer_t *q, int level, hexnode_t *n)
 {
-	hexnode_t *root;
-	pal_list_t *levels[LEVELS + 1];
-	int colors;
-	int nodes;
-} quantizer_t;
+	if (n->prev != NULL)
+		n->prev->next = n->next;
+	else
+		q->levels[level] = n->next;
+	if (n->next != NULL)
+		n->next->prev = n->prev;
+}
 
-static quantizer_t *new_quantizer ()
+static void destroy_quantizer (void *arg)
 {
-	quantizer_t *q = calloc(sizeof(quantizer_t), 1);
+	quantizer_t *q = arg;
 	int i;
 
-	q->root = new_hexnode();
-	for (i = 0; i <= LEVELS; i++)
-		q->levels[i] = pal_list_new();
+	for (i = 0; i < q->arena.n_blocks; i++)
+		free(q->arena.blocks[i]);
+	free(q->arena.blocks);
+	free(q);
+}
 
-	return q;
+static void create_quantizer_key ()
+{
+	pthread_key_create(&quantizer_key, destroy_quantizer);
 }
 
-static void destroy_quantizer (quantizer_t *q)
+/* Get the quantizer of this thread, emptied */
+static quantizer_t *get_quantizer ()
 {
-	int i;
+	quantizer_t *q;
 
-	if (q->root != NULL)
-		tree_destroy(q->root);
-	for (i = 0; i <= LEVELS; i++)
-		pal_list_destroy(q->levels[i]);
+	pthread_once(&quantizer_once, create_quantizer_key);
+	if ((q = pthread_getspecific(quantizer_key)) == NULL)
+	{
+		q = calloc(1, sizeof(quantizer_t));
+		pthread_setspecific(quantizer_key, q);
+	}
 
-	free(q);
+	/* Reset in O(1), only returning blocks of unusually colorful images */
+	while (q->arena.n_blocks > ARENA_KEEP)
+		free(q->arena.blocks[--(q->arena.n_blocks)]);
+	q->arena.used = 0;
+	memset(q->levels, 0, sizeof(q->levels));
+	q->colors = 0;
+	q->nodes = 0;
+	q->root = new_hexnode(q);
+
+	return q;
 }
 
 static int exec_find_node (hexnode_t *n, uint32_t color, hexnode_t **found, hexnode_t **last, int *index, int *level)
@@ -160,7 +219,6 @@ static int get_color_index (quantizer_t *q, uint32_t color)
 
 static void reduce (quantizer_t *q)
 {
-	pal_list_t *l;
 	hexnode_t *n, *c;
 	int i, j, k;
 
@@ -169,11 +227,7 @@ static void reduce (quantizer_t *q)
 
 	for (i = LEVELS - 1; i >= 0; i--)
 	{
-		l = q->levels[i];
-		if (pal_list_empty(l))
-			continue;
-		n = pal_list_first(l);
-		do
+		for (n = q->levels[i]; n != NULL; n = n->next)
 		{
 			if (!n->children)
 				continue;
@@ -194,14 +248,13 @@ static void reduce (quantizer_t *q)
 					n->nodes[j] = NULL;
 					q->colors--;
 					q->nodes--;
-					pal_list_remove(q->levels[i+1], c);
-					tree_destroy(c);
+					level_remove(q, i + 1, c);
 				}
 			n->leaf = 1;
 			q->colors++;
 			if (q->colors <= COLORS)
 				return;
-		} while ((n = pal_list_next(l)) != NULL);
+		}
 	}
 }
 
@@ -227,13 +280,13 @@ static void insert_color (quantizer_t *q, uint32_t color)
 		}
 		else
 		{
-			f = new_hexnode();
+			f = new_hexnode(q);
 			l->children++;
 			l->nodes[i] = f;
 			level++;
 
 			q->nodes++;
-			pal_list_insert(q->levels[level], f);
+			level_insert(q, level, f);
 
 			if (level == LEVELS)
 			{
@@ -288,24 +341,193 @@ static void get_palette (quantizer_t *q, uint32_t pal[COLORS + 1])
 		pal[index] = 0xc0decafe;
 }
 
-uint32_t *palletize (uint8_t *im, int w, int h)
+/* Get the column ranges of row y covered by crops, sorted and merged, as
+ * start and end pairs in spans. Returns the number of ranges. */
+static int row_spans (int y, int w, int num_crop, crop_t *crops, int *spans)
+{
+	int n = 0;
+	int x0, x1;
+	int i, j;
+
+	for (i = 0; i < num_crop; i++)
+	{
+		if (y < crops[i].y || y >= crops[i].y + crops[i].h)
+			continue;
+		x0 = MAX(crops[i].x, 0);
+		x1 = MIN(crops[i].x + crops[i].w, w);
+		for (j = n; j > 0 && spans[2 * (j - 1)] > x0; j--)
+		{
+			spans[2 * j] = spans[2 * (j - 1)];
+			spans[2 * j + 1] = spans[2 * (j - 1) + 1];
+		}
+		spans[2 * j] = x0;
+		spans[2 * j + 1] = x1;
+		n++;
+	}
+
+	/* Overlapping crops must not count pixels twice */
+	for (i = 1, j = 0; i < n; i++)
+	{
+		if (spans[2 * i] <= spans[2 * j + 1])
+			spans[2 * j + 1] = MAX(spans[2 * j + 1], spans[2 * i + 1]);
+		else
+		{
+			j++;
+			spans[2 * j] = spans[2 * i];
+			spans[2 * j + 1] = spans[2 * i + 1];
+		}
+	}
+
+	return n ? j + 1 : 0;
+}
+
+static inline int exact_slot (uint32_t color)
+{
+	return (color * 0x9e3779b1) >> (32 - EXACT_BITS);
+}
+
+/* Index of color, looked up in the octree only on a cache miss */
+static inline int cached_color_index (quantizer_t *q, uint32_t color)
+{
+	index_cache_t *cache = &(q->cache);
+	int s = (color * 0x9e3779b1) >> (32 - CACHE_BITS);
+
+	if (cache->colors[s] != color)
+	{
+		cache->colors[s] = color;
+		cache->indices[s] = get_color_index(q, color);
+	}
+
+	return cache->indices[s];
+}
+
+/* Images with at most COLORS colors get them as palette, unchanged. Colors
+ * are collected in an open addressing table, giving up on the first one too
+ * many. Returns 0 then, otherwise the image is indexed. */
+static int exact_palletize (uint8_t *im, int w, int y0, int y1, int num_crop, crop_t *crops, uint32_t *pal)
+{
+	uint32_t *i = (uint32_t *)im;
+	uint32_t keys[1 << EXACT_BITS];
+	uint8_t values[1 << EXACT_BITS];
+	uint32_t color, last = 0;
+	int spans[2 * PAL_MAX_CROPS];
+	int colors = 0;
+	int index = 0;
+	int n, k, s;
+	int x, y;
+
+	memset(keys, 0, sizeof(keys));
+	for (y = y0; y < y1; y++)
+	{
+		n = row_spans(y, w, num_crop, crops, spans);
+		for (k = 0; k < n; k++)
+			for (x = spans[2 * k]; x < spans[2 * k + 1]; x++)
+			{
+				if ((color = i[x + y * w]) == last)
+					continue;
+				last = color;
+				if (!color)
+					continue;
+				for (s = exact_slot(color); keys[s] && keys[s] != color; s = (s + 1) & ((1 << EXACT_BITS) - 1));
+				if (keys[s])
+					continue;
+				if (colors == COLORS)
+					return 0;
+				keys[s] = color;
+				values[s] = ++colors;
+				pal[colors] = color;
+			}
+	}
+
+	if (colors < COLORS)
+		pal[colors + 1] = 0xc0decafe;
+
+	last = 0;
+
+	for (y = y0; y < y1; y++)
+	{
+		n = row_spans(y, w, num_crop, crops, spans);
+		for (k = 0; k < n; k++)
+			for (x = spans[2 * k]; x < spans[2 * k + 1]; x++)
+			{
+				if ((color = i[x + y * w]) != last)
+				{
+					last = color;
+					if (!color)
+						index = 0;
+					else
+					{
+						for (s = exact_slot(color); keys[s] != color; s = (s + 1) & ((1 << EXACT_BITS) - 1));
+						index = values[s];
+					}
+				}
+				im[x + y * w] = index;
+			}
+	}
+
+	return 1;
+}
+
+uint32_t *palletize (uint8_t *im, int w, int h, int num_crop, crop_t *crops)
 {
 	uint32_t *pal = calloc(256, sizeof(uint32_t));
 	uint32_t *i = (uint32_t *)im;
-	quantizer_t *q = new_quantizer();
+	uint32_t color, last;
+	quantizer_t *q;
+	int spans[2 * PAL_MAX_CROPS];
+	int y0 = h, y1 = 0;
+	int n, k;
+	int index = 0;
 	int x, y;
+#if DEBUG != 0
+	pic_t p = {(char *)im, w, h, w};
+	crop_t all = {0, 0, w, h};
 
-	for (y = 0; y < h; y++)
-		for (x = 0; x < w; x++)
-			insert_color(q, i[x + y * w]);
+	/* Visible pixels outside the crops would be left out silently */
+	assert(crops_cover(p, all, crops, num_crop));
+#endif
 
-	get_palette(q, pal);
+	for (k = 0; k < num_crop; k++)
+	{
+		y0 = MIN(y0, MAX(crops[k].y, 0));
+		y1 = MAX(y1, MIN(crops[k].y + crops[k].h, h));
+	}
+
+	if (exact_palletize(im, w, y0, y1, num_crop, crops, pal))
+		return pal;
+	memset(pal, 0, 256 * sizeof(uint32_t));
+	q = get_quantizer();
+
+	/* Pixels are visited in frame order, so the tree is built in the same
+	 * order as for the whole frame */
+	for (y = y0; y < y1; y++)
+	{
+		n = row_spans(y, w, num_crop, crops, spans);
+		for (k = 0; k < n; k++)
+			for (x = spans[2 * k]; x < spans[2 * k + 1]; x++)
+				insert_color(q, i[x + y * w]);
+	}
 
-	for (y = 0; y < h; y++)
-		for (x = 0; x < w; x++)
-			im[x + y * w] = get_color_index(q, i[x + y * w]);
+	get_palette(q, pal);
 
-	destroy_quantizer(q);
+	/* Indices are written in front of the pixels still to be read. Runs of
+	 * one color, like glyph fills, are only looked up once. */
+	memset(&(q->cache), 0, sizeof(index_cache_t));
+	last = 0;
+	for (y = y0; y < y1; y++)
+	{
+		n = row_spans(y, w, num_crop, crops, spans);
+		for (k = 0; k < n; k++)
+			for (x = spans[2 * k]; x < spans[2 * k + 1]; x++)
+			{
+				if ((color = i[x + y * w]) != last)
+				{
+					last = color;
+					index = cached_color_index(q, color);
+				}
+				im[x + y * w] = index;
+			}
+	}
 
 	return pal;
 }
@@ -19,8 +19,19 @@
 #ifndef QUANTIZE_H
 #define QUANTIZE_H
 
-/* Return malloced palette and overwrite im with 8bpp data */
-uint32_t *palletize (char *im, int w, int h);
+#include <stdint.h>
+#include "auto_split.h"
+
+#define PAL_MAX_CROPS 2
+
+/* Return malloced palette and overwrite the pixels of im inside the up to
+ * PAL_MAX_CROPS crops with 8bpp data, keeping the stride of w. Pixels outside
+ * the crops must be 100% transparent, other 8bpp data is undefined. Visible
+ * pixels outside the crops are silently left out of the palette, so callers
+ * pass crops that cover every visible pixel, as auto_crop, auto_split and
+ * the reused crops of the previous event do. This is asserted, when
+ * palletize.c is built with -DDEBUG=1. */
+uint32_t *palletize (uint8_t *im, int w, int h, int num_crop, crop_t *crops);
 
 #endif
 
@@ -0,0 +1,743 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+/* PNG encoder for subtitle images. Those are mostly long runs of transparent
+ * pixels with some edge colors, so matches against the previous pixel (runs)
+ * and the pixel above are tried first, and only then a small hash table of
+ * earlier positions. Blocks are written with fixed or fitted Huffman codes,
+ * or stored, whichever is smallest.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include "png_writer.h"
+
+#define BLOCK_SIZE (1 << 18)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define WINDOW_SIZE 32768
+#define STORED_SIZE 65535
+#define HASH_BITS 15
+#define CHAIN_DEPTH 32
+#define GOOD_MATCH 32
+
+#define FILTER_NONE 0
+#define FILTER_UP 2
+
+static const int len_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const int len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const int dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const int dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const int cl_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+typedef struct bit_writer_s
+{
+	uint8_t *out;
+	int pos;
+	uint64_t bits;
+	int n_bits;
+} bit_writer_t;
+
+typedef struct huffman_s
+{
+	uint8_t lit_len[288];
+	uint16_t lit_code[288];
+	uint8_t dist_len[30];
+	uint16_t dist_code[30];
+} huffman_t;
+
+typedef struct deflate_s
+{
+	bit_writer_t bw;
+	uint32_t *tokens; /* Literal byte, or 1 << 31 | length << 16 | distance */
+	int n_tokens;
+	uint32_t lit_freq[288];
+	uint32_t dist_freq[30];
+	uint8_t len_sym[MAX_MATCH + 1];
+	int hash_bits;
+	int *head;        /* Last position by hash of 4 bytes, or -1 */
+	int *chain;       /* Previous position with the same hash, or NULL */
+} deflate_t;
+
+/* Up to 32 bits at a time, LSB first */
+static inline void put_bits (bit_writer_t *bw, uint32_t v, int n)
+{
+	bw->bits |= (uint64_t)v << bw->n_bits;
+	bw->n_bits += n;
+	if (bw->n_bits >= 32)
+	{
+		bw->out[bw->pos] = bw->bits;
+		bw->out[bw->pos + 1] = bw->bits >> 8;
+		bw->out[bw->pos + 2] = bw->bits >> 16;
+		bw->out[bw->pos + 3] = bw->bits >> 24;
+		bw->pos += 4;
+		bw->bits >>= 32;
+		bw->n_bits -= 32;
+	}
+}
+
+static void align_bits (bit_writer_t *bw)
+{
+	while (bw->n_bits > 0)
+	{
+		bw->out[bw->pos++] = bw->bits;
+		bw->bits >>= 8;
+		bw->n_bits -= 8;
+	}
+	bw->bits = 0;
+	bw->n_bits = 0;
+}
+
+static void put_u32 (uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static int dist_sym (int d)
+{
+	int i = 29;
+
+	if (d <= 4)
+		return d - 1;
+	while (dist_base[i] > d)
+		i--;
+
+	return i;
+}
+
+static uint16_t reverse_bits (uint16_t code, int n)
+{
+	uint16_t r = 0;
+
+	while (n--)
+	{
+		r = (r << 1) | (code & 1);
+		code >>= 1;
+	}
+
+	return r;
+}
+
+/* In-place minimum redundancy code lengths (Moffat and Katajainen). a holds
+ * n >= 2 weights in ascending order and receives code lengths, longest first.
+ */
+static void code_lengths (int *a, int n)
+{
+	int root, leaf, next, avail, used, depth;
+
+	a[0] += a[1];
+	root = 0;
+	leaf = 2;
+	for (next = 1; next < n - 1; next++)
+	{
+		if (leaf >= n || a[root] < a[leaf])
+		{
+			a[next] = a[root];
+			a[root++] = next;
+		}
+		else
+			a[next] = a[leaf++];
+		if (leaf >= n || (root < next && a[root] < a[leaf]))
+		{
+			a[next] += a[root];
+			a[root++] = next;
+		}
+		else
+			a[next] += a[leaf++];
+	}
+
+	a[n - 2] = 0;
+	for (next = n - 3; next >= 0; next--)
+		a[next] = a[a[next]] + 1;
+
+	avail = 1;
+	used = depth = 0;
+	root = n - 2;
+	next = n - 1;
+	while (avail > 0)
+	{
+		while (root >= 0 && a[root] == depth)
+		{
+			used++;
+			root--;
+		}
+		while (avail > used)
+		{
+			a[next--] = depth;
+			avail--;
+		}
+		avail = 2 * used;
+		depth++;
+		used = 0;
+	}
+}
+
+/* Huffman code lengths of at most max_bits for n symbols. The code is always
+ * complete, as inflate implementations reject incomplete ones. */
+static void build_lengths (uint32_t *freq, int n, int max_bits, uint8_t *len)
+{
+	uint64_t keys[288], t;
+	int a[288];
+	int bl_count[16] = {0};
+	int count = 0;
+	int kraft, bits;
+	int i, j;
+
+	memset(len, 0, n);
+	for (i = 0; i < n; i++)
+		if (freq[i])
+			keys[count++] = ((uint64_t)freq[i] << 16) | i;
+	if (count < 2)
+	{
+		/* Two one bit codes, one of them unused */
+		i = count ? keys[0] & 0xffff : 0;
+		len[i] = 1;
+		len[i ? 0 : 1] = 1;
+		return;
+	}
+
+	/* Sort by frequency */
+	for (i = 1; i < count; i++)
+	{
+		t = keys[i];
+		for (j = i; j > 0 && keys[j - 1] > t; j--)
+			keys[j] = keys[j - 1];
+		keys[j] = t;
+	}
+	for (i = 0; i < count; i++)
+		a[i] = keys[i] >> 16;
+	code_lengths(a, count);
+
+	/* Limit lengths, then lengthen shorter codes until the code is complete
+	 * again, like zlib does */
+	kraft = 0;
+	for (i = 0; i < count; i++)
+	{
+		bits = MIN(a[i], max_bits);
+		bl_count[bits]++;
+		kraft += 1 << (max_bits - bits);
+	}
+	while (kraft > 1 << max_bits)
+	{
+		bits = max_bits - 1;
+		while (!bl_count[bits])
+			bits--;
+		bl_count[bits]--;
+		bl_count[bits + 1] += 2;
+		bl_count[max_bits]--;
+		kraft--;
+	}
+
+	/* Least frequent symbols get the longest codes */
+	i = 0;
+	for (bits = max_bits; bits > 0; bits--)
+		for (j = bl_count[bits]; j > 0; j--)
+			len[keys[i++] & 0xffff] = bits;
+}
+
+static void build_codes (uint8_t *len, int n, uint16_t *code)
+{
+	int bl_count[16] = {0};
+	int next[16];
+	int c = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		bl_count[len[i]]++;
+	bl_count[0] = 0;
+	for (i = 1; i < 16; i++)
+	{
+		c = (c + bl_count[i - 1]) << 1;
+		next[i] = c;
+	}
+	for (i = 0; i < n; i++)
+		if (len[i])
+			code[i] = reverse_bits(next[len[i]]++, len[i]);
+}
+
+static void fixed_huffman (huffman_t *h)
+{
+	int i;
+
+	for (i = 0; i < 288; i++)
+		h->lit_len[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+	for (i = 0; i < 30; i++)
+		h->dist_len[i] = 5;
+	build_codes(h->lit_len, 288, h->lit_code);
+	build_codes(h->dist_len, 30, h->dist_code);
+}
+
+/* Bits needed for the tokens of the current block with code h */
+static int block_bits (deflate_t *d, huffman_t *h)
+{
+	int bits = 0;
+	int i;
+
+	for (i = 0; i < 286; i++)
+		bits += d->lit_freq[i] * (h->lit_len[i] + (i > 256 ? len_extra[i - 257] : 0));
+	for (i = 0; i < 30; i++)
+		bits += d->dist_freq[i] * (h->dist_len[i] + dist_extra[i]);
+
+	return bits;
+}
+
+/* Code length symbols of a dynamic block header, with extra bits in the upper
+ * byte. Returns the number of symbols. */
+static int code_length_syms (uint8_t *lens, int n, uint16_t *syms, uint32_t *cl_freq)
+{
+	int n_syms = 0;
+	int run, r, k;
+	int i;
+
+	for (i = 0; i < n; i += run)
+	{
+		for (run = 1; i + run < n && lens[i + run] == lens[i]; run++)
+			;
+		r = run;
+		if (!lens[i])
+		{
+			for (; r >= 11; r -= k)
+			{
+				k = MIN(r, 138);
+				syms[n_syms++] = 18 | (k - 11) << 8;
+			}
+			if (r >= 3)
+			{
+				syms[n_syms++] = 17 | (r - 3) << 8;
+				r = 0;
+			}
+		}
+		else
+		{
+			syms[n_syms++] = lens[i];
+			for (r--; r >= 3; r -= k)
+			{
+				k = MIN(r, 6);
+				syms[n_syms++] = 16 | (k - 3) << 8;
+			}
+		}
+		for (; r > 0; r--)
+			syms[n_syms++] = lens[i];
+	}
+	for (i = 0; i < n_syms; i++)
+		cl_freq[syms[i] & 0xff]++;
+
+	return n_syms;
+}
+
+static void write_tokens (deflate_t *d, huffman_t *h)
+{
+	bit_writer_t *bw = &(d->bw);
+	uint32_t t;
+	int len, dist, s;
+	int i;
+
+	for (i = 0; i < d->n_tokens; i++)
+	{
+		t = d->tokens[i];
+		if (!(t >> 31))
+		{
+			put_bits(bw, h->lit_code[t], h->lit_len[t]);
+			continue;
+		}
+		len = (t >> 16) & 0x1ff;
+		dist = t & 0xffff;
+		s = d->len_sym[len];
+		put_bits(bw, h->lit_code[257 + s], h->lit_len[257 + s]);
+		if (len_extra[s])
+			put_bits(bw, len - len_base[s], len_extra[s]);
+		s = dist_sym(dist);
+		put_bits(bw, h->dist_code[s], h->dist_len[s]);
+		if (dist_extra[s])
+			put_bits(bw, dist - dist_base[s], dist_extra[s]);
+	}
+	put_bits(bw, h->lit_code[256], h->lit_len[256]);
+}
+
+static void write_stored (bit_writer_t *bw, uint8_t *data, int n, int last)
+{
+	int k;
+
+	do
+	{
+		k = MIN(n, STORED_SIZE);
+		put_bits(bw, last && k == n, 1);
+		put_bits(bw, 0, 2);
+		align_bits(bw);
+		bw->out[bw->pos++] = k;
+		bw->out[bw->pos++] = k >> 8;
+		bw->out[bw->pos++] = ~k;
+		bw->out[bw->pos++] = ~k >> 8;
+		memcpy(bw->out + bw->pos, data, k);
+		bw->pos += k;
+		data += k;
+		n -= k;
+	} while (n > 0);
+}
+
+static inline int match_length (uint8_t *a, uint8_t *b, int max)
+{
+	uint64_t x, y;
+	int n = 0;
+
+	while (n + 8 <= max)
+	{
+		memcpy(&x, a + n, 8);
+		memcpy(&y, b + n, 8);
+		if (x != y)
+			return n + (__builtin_ctzll(x ^ y) >> 3);
+		n += 8;
+	}
+	while (n < max && a[n] == b[n])
+		n++;
+
+	return n;
+}
+
+static inline uint32_t hash4 (uint8_t *p, int bits)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+
+	return (v * 2654435761u) >> (32 - bits);
+}
+
+static inline void insert_hash (deflate_t *d, uint8_t *f, int p)
+{
+	uint32_t h = hash4(f + p, d->hash_bits);
+
+	if (d->chain != NULL)
+		d->chain[p & (WINDOW_SIZE - 1)] = d->head[h];
+	d->head[h] = p;
+}
+
+/* Tokenize f[start] to f[end - 1], trying matches at run_dist and, if not 0,
+ * row_dist bytes back, then earlier positions with the same hash */
+static void find_matches (deflate_t *d, uint8_t *f, int start, int end, int run_dist, int row_dist)
+{
+	int p = start;
+	int max, best, dist, l;
+	int cand, depth, i;
+
+	memset(d->lit_freq, 0, sizeof(d->lit_freq));
+	memset(d->dist_freq, 0, sizeof(d->dist_freq));
+	d->n_tokens = 0;
+	while (p < end)
+	{
+		max = MIN(MAX_MATCH, end - p);
+		best = 0;
+		dist = 0;
+		if (max >= MIN_MATCH)
+		{
+			if (p >= run_dist)
+			{
+				best = match_length(f + p, f + p - run_dist, max);
+				dist = run_dist;
+			}
+			if (row_dist && p >= row_dist && best < max)
+			{
+				l = match_length(f + p, f + p - row_dist, max);
+				if (l > best)
+				{
+					best = l;
+					dist = row_dist;
+				}
+			}
+			if (d->head != NULL && max >= 4)
+			{
+				cand = d->head[hash4(f + p, d->hash_bits)];
+				for (depth = d->chain != NULL ? CHAIN_DEPTH : 1; depth > 0 && best < GOOD_MATCH && best < max && cand >= 0 && p - cand <= WINDOW_SIZE; depth--)
+				{
+					/* Check the byte after the current best first */
+					if (f[cand + best] == f[p + best])
+					{
+						l = match_length(f + p, f + cand, max);
+						if (l > best)
+						{
+							best = l;
+							dist = p - cand;
+						}
+					}
+					if (d->chain == NULL)
+						break;
+					cand = d->chain[cand & (WINDOW_SIZE - 1)];
+				}
+				/* Short matches are indexed completely, long ones are
+				 * mostly runs and only indexed at their start */
+				if (best >= MIN_MATCH && best < 16)
+					for (i = 0; i < best && p + i + 4 <= end; i++)
+						insert_hash(d, f, p + i);
+				else
+					insert_hash(d, f, p);
+			}
+		}
+		if (best >= MIN_MATCH)
+		{
+			d->tokens[d->n_tokens++] = 1u << 31 | best << 16 | dist;
+			d->lit_freq[257 + d->len_sym[best]]++;
+			d->dist_freq[dist_sym(dist)]++;
+			p += best;
+		}
+		else
+		{
+			d->tokens[d->n_tokens++] = f[p];
+			d->lit_freq[f[p]]++;
+			p++;
+		}
+	}
+	d->lit_freq[256] = 1;
+}
+
+/* Write f[start] to f[end - 1] as one block, or several stored ones */
+static void write_block (deflate_t *d, huffman_t *fixed, uint8_t *f, int start, int end, int level, int row_dist, int run_dist, int last)
+{
+	bit_writer_t *bw = &(d->bw);
+	huffman_t dyn;
+	uint16_t cl_syms[286 + 30];
+	uint32_t cl_freq[19] = {0};
+	uint8_t lens[286 + 30];
+	uint8_t cl_len[19];
+	uint16_t cl_code[19];
+	int n = end - start;
+	int stored_bits, fixed_bits, dyn_bits = 0;
+	int hlit, hdist, hclen, n_cl;
+	int s, i;
+
+	stored_bits = (MAX(1, (n + STORED_SIZE - 1) / STORED_SIZE)) * (10 + 32) + 8 * n;
+	if (level == 0)
+	{
+		write_stored(bw, f + start, n, last);
+		return;
+	}
+
+	find_matches(d, f, start, end, run_dist, row_dist);
+	fixed_bits = 3 + block_bits(d, fixed);
+
+	if (level >= 2)
+	{
+		build_lengths(d->lit_freq, 286, 15, dyn.lit_len);
+		build_lengths(d->dist_freq, 30, 15, dyn.dist_len);
+		build_codes(dyn.lit_len, 286, dyn.lit_code);
+		build_codes(dyn.dist_len, 30, dyn.dist_code);
+		for (hlit = 286; hlit > 257 && !dyn.lit_len[hlit - 1]; hlit--)
+			;
+		for (hdist = 30; hdist > 1 && !dyn.dist_len[hdist - 1]; hdist--)
+			;
+		memcpy(lens, dyn.lit_len, hlit);
+		memcpy(lens + hlit, dyn.dist_len, hdist);
+		n_cl = code_length_syms(lens, hlit + hdist, cl_syms, cl_freq);
+		build_lengths(cl_freq, 19, 7, cl_len);
+		build_codes(cl_len, 19, cl_code);
+		for (hclen = 19; hclen > 4 && !cl_len[cl_order[hclen - 1]]; hclen--)
+			;
+
+		dyn_bits = 3 + 14 + 3 * hclen + block_bits(d, &dyn);
+		for (i = 0; i < 19; i++)
+			dyn_bits += cl_freq[i] * (cl_len[i] + (i == 16 ? 2 : i == 17 ? 3 : i == 18 ? 7 : 0));
+	}
+
+	if (stored_bits < fixed_bits && (level < 2 || stored_bits < dyn_bits))
+		write_stored(bw, f + start, n, last);
+	else if (level < 2 || fixed_bits <= dyn_bits)
+	{
+		put_bits(bw, last, 1);
+		put_bits(bw, 1, 2);
+		write_tokens(d, fixed);
+	}
+	else
+	{
+		put_bits(bw, last, 1);
+		put_bits(bw, 2, 2);
+		put_bits(bw, hlit - 257, 5);
+		put_bits(bw, hdist - 1, 5);
+		put_bits(bw, hclen - 4, 4);
+		for (i = 0; i < hclen; i++)
+			put_bits(bw, cl_len[cl_order[i]], 3);
+		for (i = 0; i < n_cl; i++)
+		{
+			s = cl_syms[i] & 0xff;
+			put_bits(bw, cl_code[s], cl_len[s]);
+			if (s >= 16)
+				put_bits(bw, cl_syms[i] >> 8, s == 16 ? 2 : s == 17 ? 3 : 7);
+		}
+		write_tokens(d, &dyn);
+	}
+}
+
+/* Bytes of row differing from the one bpp bytes before */
+static int count_breaks (uint8_t *row, int n, int bpp)
+{
+	int breaks = 0;
+	int i;
+
+	for (i = bpp; i < n; i++)
+		breaks += row[i] != row[i - bpp];
+
+	return breaks;
+}
+
+/* Filter rows into f. Filters are chosen to give long runs, preferring none,
+ * which keeps runs going across rows. */
+static void filter_rows (uint8_t *f, uint8_t *image, int w, int bpp, crop_t c, int level)
+{
+	int row_bytes = c.w * bpp;
+	uint8_t *src, *prev = NULL, *dst;
+	int prev_filter = FILTER_NONE;
+	int none, up;
+	int x, y;
+
+	for (y = 0; y < c.h; y++)
+	{
+		src = image + bpp * (c.x + w * (c.y + y));
+		dst = f + y * (row_bytes + 1);
+		dst[0] = FILTER_NONE;
+		/* Rows repeating the previous one, or a single run, stay unfiltered */
+		if (level >= 2 && prev != NULL && !(prev_filter == FILTER_NONE && !memcmp(src, prev, row_bytes)) && (none = count_breaks(src, row_bytes, bpp)) > 0)
+		{
+			for (x = 0; x < row_bytes; x++)
+				dst[x + 1] = src[x] - prev[x];
+			up = count_breaks(dst + 1, row_bytes, bpp);
+			if (up < none)
+				dst[0] = FILTER_UP;
+		}
+		if (dst[0] == FILTER_NONE)
+			memcpy(dst + 1, src, row_bytes);
+		prev_filter = dst[0];
+		prev = src;
+	}
+}
+
+static uint8_t *put_chunk (uint8_t *p, char *type, uint8_t *data, int len)
+{
+	put_u32(p, len);
+	memcpy(p + 4, type, 4);
+	if (data != NULL && data != p + 8)
+		memcpy(p + 8, data, len);
+	put_u32(p + 8 + len, crc32(0, p + 4, len + 4));
+
+	return p + 12 + len;
+}
+
+uint8_t *encode_png (uint8_t *image, int w, uint32_t *pal, crop_t c, int level, int *size)
+{
+	static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+	int bpp = pal == NULL ? 4 : 1;
+	int n = c.h * (c.w * bpp + 1);
+	int row_dist = c.w * bpp + 1;
+	int colors = 0;
+	uint8_t ihdr[13];
+	uint8_t plte[256 * 3];
+	uint8_t trns[256];
+	uint8_t *col;
+	uint8_t *f, *png, *p, *idat;
+	huffman_t fixed;
+	deflate_t d;
+	int start, end, s, i;
+
+	f = malloc(n);
+	png = malloc(8 + 25 + 12 + 256 * 3 + 12 + 256 + 12 + 2 + n + n / 1000 + 64 * (n / BLOCK_SIZE + 1) + 4 + 12 + 1024);
+	d.tokens = level ? malloc(MIN(n, BLOCK_SIZE) * sizeof(uint32_t)) : NULL;
+	/* Small images get a smaller hash table, as clearing it dominates */
+	for (d.hash_bits = 10; d.hash_bits < HASH_BITS && 1 << d.hash_bits < n; d.hash_bits++)
+		;
+	d.head = level >= 2 ? malloc((1 << d.hash_bits) * sizeof(int)) : NULL;
+	d.chain = level >= 3 ? malloc(MIN(n, WINDOW_SIZE) * sizeof(int)) : NULL;
+	if (f == NULL || png == NULL || (level && d.tokens == NULL) || (level >= 2 && d.head == NULL) || (level >= 3 && d.chain == NULL))
+	{
+		fprintf(stderr, "Error: Cannot allocate PNG buffers.\n");
+		exit(1);
+	}
+
+	/* Header */
+	p = png;
+	memcpy(p, signature, 8);
+	p += 8;
+	put_u32(ihdr, c.w);
+	put_u32(ihdr + 4, c.h);
+	ihdr[8] = 8;
+	ihdr[9] = pal == NULL ? 6 : 3;
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+	p = put_chunk(p, "IHDR", ihdr, 13);
+	if (pal != NULL)
+	{
+		memset(plte, 0, 3);
+		trns[0] = 0;
+		colors = 1;
+		for (i = 1; i < 256 && pal[i]; i++)
+		{
+			col = (uint8_t *)&(pal[i]);
+			plte[i * 3] = col[0];
+			plte[i * 3 + 1] = col[1];
+			plte[i * 3 + 2] = col[2];
+			trns[i] = col[3];
+			colors++;
+		}
+		p = put_chunk(p, "PLTE", plte, colors * 3);
+		p = put_chunk(p, "tRNS", trns, colors);
+	}
+
+	/* Image data */
+	filter_rows(f, image, w, bpp, c, level);
+	if (row_dist > WINDOW_SIZE)
+		row_dist = 0;
+	if (d.head != NULL)
+		memset(d.head, -1, (1 << d.hash_bits) * sizeof(int));
+	for (i = 0, s = 0; i <= MAX_MATCH; i++)
+	{
+		while (s < 28 && len_base[s + 1] <= i)
+			s++;
+		d.len_sym[i] = s;
+	}
+	fixed_huffman(&fixed);
+
+	idat = p + 8;
+	idat[0] = 0x78;
+	idat[1] = level <= 1 ? 0x01 : level == 2 ? 0x5e : 0x9c;
+	d.bw.out = idat + 2;
+	d.bw.pos = 0;
+	d.bw.bits = 0;
+	d.bw.n_bits = 0;
+	start = 0;
+	do
+	{
+		end = MIN(n, start + BLOCK_SIZE);
+		write_block(&d, &fixed, f, start, end, level, row_dist, bpp, end == n);
+		start = end;
+	} while (start < n);
+	align_bits(&(d.bw));
+	put_u32(idat + 2 + d.bw.pos, adler32(1, f, n));
+	p = put_chunk(p, "IDAT", idat, 2 + d.bw.pos + 4);
+	p = put_chunk(p, "IEND", NULL, 0);
+
+	free(f);
+	free(d.tokens);
+	free(d.head);
+	free(d.chain);
+	*size = p - png;
+
+	return png;
+}
@@ -1,6 +1,6 @@
 /*----------------------------------------------------------------------------
- * sort.h - Generic heapsort header
- * Copyright (C) 2011 Arne Bochem <heapsort at ps-auxw de>
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -16,14 +16,22 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *----------------------------------------------------------------------------*/
 
-#ifndef SORT_H
-#define SORT_H
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
 
 #include <stdint.h>
+#include "auto_split.h"
 
-/* Returns 1 if a > b, 0 otherwise. */
-typedef int (*sort_func_t)(void *, void *);
+/* Highest level handled by encode_png, higher levels use libpng and zlib */
+#define PNG_MAX_FAST_LEVEL 3
 
-void sort (sort_func_t cmp, void **data, uint32_t len);
+/* Encode area c of image as a complete PNG file. If pal is NULL, pixels are
+ * RGBA, otherwise palette indices, with pal as in write_png. Rows are w
+ * pixels apart. Level 0 stores the data uncompressed, 1 only compresses
+ * runs and repeated rows, 2 also picks a filter per row, searches earlier
+ * data by hash and fits Huffman codes to each block, 3 searches harder.
+ * Returns a buffer of *size bytes, which has to be freed.
+ */
+uint8_t *encode_png (uint8_t *image, int w, uint32_t *pal, crop_t c, int level, int *size);
 
 #endif
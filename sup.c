@@ -21,6 +21,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "auto_split.h"
 #include "sup.h"
 #include "abstract_lists.h"
@@ -43,32 +46,56 @@
 #define DEBUG 0
 #endif
 
-static int count (uint8_t *im, int x, int w, int col)
+/* Length of the run of col starting at x, up to w, at most 16383 (14 bit) */
+static inline int count (uint8_t *im, int x, int w, uint8_t col)
 {
-	int c = 0;
-	for (; x < w && im[x] == col && c <= 16383; x++) /* 14bit max */
-		c++;
-	return c;
+	int end = MIN(w, x + 16383);
+	int c = x;
+#ifdef __SSE2__
+	__m128i v = _mm_set1_epi8(col);
+	int m;
+
+	for (; c + 16 <= end; c += 16)
+	{
+		m = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(im + c)), v)) & 0xffff;
+		if (m)
+			return c + __builtin_ctz(m) - x;
+	}
+#endif
+	for (; c < end && im[c] == col; c++);
+	return c - x;
 }
 
+/* Worst case is a single transparent pixel, taking two bytes, plus two bytes
+ * end of line marker per row */
+#define RLE_MAX_SIZE(w,h) ((size_t)(h) * (2 * (w) + 2))
+
 /* Output buffer will contain malloced RLE data */
-#define PUSH(x) {*(b++)=(x);(*len)++;}
+#define PUSH(x) {*(b++)=(x);}
 #define FLAG_COLOR 0x80
 #define FLAG_LONG 0x40
 static uint8_t *rl_encode (uint8_t *im, int w, int h, rect_t crop, int *len)
 {
-	uint8_t *b = calloc(crop.w * crop.h, 4); /* Over-allocation */
-	uint8_t *rle = b;
+	uint8_t *rle = malloc(MAX(1, RLE_MAX_SIZE(crop.w, crop.h)));
+	uint8_t *b = rle;
+	uint8_t *row;
 	uint8_t col, o;
-	int x, y, c;
+	int x, y, c, x1;
 
-	*len = 0;
+	if (rle == NULL)
+	{
+		fprintf(stderr, "Error: Cannot allocate RLE buffer.\n");
+		exit(1);
+	}
+
+	x1 = MIN(crop.x + crop.w, w);
 	for (y = crop.y; y < crop.y + crop.h && y < h; y++)
 	{
-		for (x = crop.x; x < crop.x + crop.w && x < w; x += c)
+		row = im + y * w;
+		for (x = crop.x; x < x1; x += c)
 		{
-			col = im[x + y * w];
-			c = count(im + y * w, x, MIN(crop.x + crop.w, w), col);
+			col = row[x];
+			c = count(row, x, x1, col);
 
 			/* Shorter than shortest range encoding */
 			if (c < 3 && col)
@@ -107,9 +134,66 @@ static uint8_t *rl_encode (uint8_t *im, int w, int h, rect_t crop, int *len)
 		PUSH(0);
 	}
 
+	/* Give back what the worst case bound did not need */
+	*len = b - rle;
+	if ((b = realloc(rle, MAX(1, *len))) != NULL)
+		rle = b;
+
 	return rle;
 }
 
+/* Segments are assembled in memory and written once per display set */
+static uint8_t *reserve (sup_writer_t *sw, int len)
+{
+	uint8_t *p;
+
+	if (sw->buf_len + len > sw->buf_size)
+	{
+		sw->buf_size = MAX(MAX(2 * sw->buf_size, sw->buf_len + len), 4096);
+		if ((sw->buf = realloc(sw->buf, sw->buf_size)) == NULL)
+		{
+			fprintf(stderr, "Error: Cannot allocate SUP output buffer.\n");
+			exit(1);
+		}
+	}
+	p = sw->buf + sw->buf_len;
+	sw->buf_len += len;
+
+	return p;
+}
+
+static void put (sup_writer_t *sw, void *data, int len)
+{
+	memcpy(reserve(sw, len), data, len);
+}
+
+static void flush_sup (sup_writer_t *sw)
+{
+	if (sw->buf_len && fwrite(sw->buf, sw->buf_len, 1, sw->fh) != 1)
+	{
+		perror("Error writing SUP/PGS file");
+		exit(1);
+	}
+	sw->buf_len = 0;
+}
+
+/* Large image data is written directly, instead of being copied */
+#define DIRECT_WRITE 16384
+static void put_payload (sup_writer_t *sw, uint8_t *data, int len)
+{
+	if (len < DIRECT_WRITE)
+	{
+		put(sw, data, len);
+		return;
+	}
+	flush_sup(sw);
+	if (fwrite(data, len, 1, sw->fh) != 1)
+	{
+		perror("Error writing SUP/PGS file");
+		exit(1);
+	}
+}
+
 typedef struct sup_header_s
 {
 	uint8_t m1;          /* 'P' */
@@ -127,7 +211,7 @@ void conv_sup_header (sup_header_t *h)
 	h->packet_len = SWAP16(h->packet_len);
 }
 
-static void write_header (FILE *fh, int start_time, int dts, int packet_type, int packet_len)
+static void write_header (sup_writer_t *sw, int start_time, int dts, int packet_type, int packet_len)
 {
 	sup_header_t h;
 
@@ -138,7 +222,7 @@ static void write_header (FILE *fh, int start_time, int dts, int packet_type, in
 	h.packet_len = packet_len;
 
 	conv_sup_header(&h);
-	fwrite(&h, sizeof(h), 1, fh);
+	put(sw, &h, sizeof(h));
 }
 
 typedef struct sup_pcs_start_s
@@ -147,8 +231,8 @@ typedef struct sup_pcs_start_s
 	uint16_t height; /* height - 2 * Core.getCropOfsY */
 	uint8_t fps_id; /* getFpsId() */
 	uint16_t comp_num;
-	uint8_t follower;  /* 0x80 if first or single, 0x40 if follows directly (end = start) or the frame after */
-	uint16_t m; /* 0 */
+	uint8_t follower;  /* 0x80 if first or single, 0x40 if follows directly (end = start) or the frame after, 0 for palette updates */
+	uint16_t m; /* 0, 0x8000 for palette updates */
 	uint8_t objects; /* 1 */
 } __attribute ((packed)) sup_pcs_start_t;
 
@@ -176,25 +260,27 @@ void conv_sup_pcs_start_obj (sup_pcs_start_obj_t *pcsso)
 	pcsso->y_off = SWAP16(pcsso->y_off);
 }
 
-static void write_pcs_start (FILE *fh, int start_time, int dts, int follower, int objects, int vid_w, int vid_h, int fps_id, int comp_num)
+static void write_pcs_start (sup_writer_t *sw, int start_time, int dts, int follower, int objects, int vid_w, int vid_h, int fps_id, int comp_num, int palette_update)
 {
 	sup_pcs_start_t pcss;
 
-	write_header(fh, start_time, dts, 22, sizeof(pcss) + objects * sizeof(sup_pcs_start_obj_t));
+	write_header(sw, start_time, dts, 22, sizeof(pcss) + objects * sizeof(sup_pcs_start_obj_t));
 
-	pcss.m = 0;
+	pcss.m = palette_update ? 0x8000 : 0;
 	pcss.width = vid_w;
 	pcss.height = vid_h;
 	pcss.fps_id = fps_id;
 	pcss.comp_num = comp_num;
 	pcss.follower = !follower ? 0x80 : 0x40; /* 0x80 for single lines, and first lines, 0x40 for following directly or with one frame between */
+	if (palette_update)
+		pcss.follower = 0;
 	pcss.objects = objects;
 
 	conv_sup_pcs_start(&pcss);
-	fwrite(&pcss, sizeof(pcss), 1, fh);
+	put(sw, &pcss, sizeof(pcss));
 }
 
-static void write_pcs_start_obj (FILE *fh, int picture, int window, int x_off, int y_off, int forced)
+static void write_pcs_start_obj (sup_writer_t *sw, int picture, int window, int x_off, int y_off, int forced)
 {
 	sup_pcs_start_obj_t pcsso;
 
@@ -205,7 +291,7 @@ static void write_pcs_start_obj (FILE *fh, int picture, int window, int x_off, i
 	pcsso.y_off = y_off;
 
 	conv_sup_pcs_start_obj(&pcsso);
-	fwrite(&pcsso, sizeof(pcsso), 1, fh);
+	put(sw, &pcsso, sizeof(pcsso));
 }
 
 typedef struct sup_wds_s
@@ -235,19 +321,19 @@ void conv_sup_wds_obj (sup_wds_obj_t *wdso)
 	wdso->height = SWAP16(wdso->height);
 }
 
-static void write_wds (FILE *fh, int timestamp, int dts, int windows)
+static void write_wds (sup_writer_t *sw, int timestamp, int dts, int windows)
 {
 	sup_wds_t wds;
 
-	write_header(fh, timestamp, dts, 23, sizeof(wds) + windows * sizeof(sup_wds_obj_t));
+	write_header(sw, timestamp, dts, 23, sizeof(wds) + windows * sizeof(sup_wds_obj_t));
 
 	wds.windows = windows;
 
 	conv_sup_wds(&wds);
-	fwrite(&wds, sizeof(wds), 1, fh);
+	put(sw, &wds, sizeof(wds));
 }
 
-static void write_wds_obj (FILE *fh, int window, int w, int h, int x_off, int y_off)
+static void write_wds_obj (sup_writer_t *sw, int window, int w, int h, int x_off, int y_off)
 {
 	sup_wds_obj_t wdso;
 
@@ -258,7 +344,7 @@ static void write_wds_obj (FILE *fh, int window, int w, int h, int x_off, int y_
 	wdso.height = h;
 
 	conv_sup_wds_obj(&wdso);
-	fwrite(&wdso, sizeof(wdso), 1, fh);
+	put(sw, &wdso, sizeof(wdso));
 }
 
 #define CLAMP(x,min,max) (MAX(MIN(x,max),min))
@@ -301,21 +387,22 @@ void conv_sup_palette (sup_palette_t *p)
 }
 
 /* Colorspace = 1 for 480p/576p, 0 otherwise */
-#define PUT(x) { t = (uint8_t)(x); fwrite(&t, 1, 1, fh); }
-static void write_palette (FILE *fh, int dts, int palette, uint32_t *pal, int colorspace)
+#define PUT(x) { *(e++) = (uint8_t)(x); }
+static void write_palette (sup_writer_t *sw, int dts, int palette, uint32_t *pal, int colorspace)
 {
 	sup_palette_t p;
 	int entries = 1, i;
-	uint8_t t;
+	uint8_t *e;
 
 	for (i = 1; i < 256 && pal[i]; i++)
 		entries++;
-	write_header(fh, dts, 0, 20, sizeof(p) + entries * 5);
+	write_header(sw, dts, 0, 20, sizeof(p) + entries * 5);
 
 	p.palette = palette;
 	conv_sup_palette(&p);
-	fwrite(&p, sizeof(p), 1, fh);
+	put(sw, &p, sizeof(p));
 
+	e = reserve(sw, entries * 5);
 	for (i = 0; i < entries; i++)
 	{
 		PUT(i)
@@ -355,7 +442,7 @@ void conv_sup_ods_next (sup_ods_next_t *odsn)
 	odsn->picture = SWAP16(odsn->picture);
 }
 
-static void write_image (FILE *fh, int timestamp, int dts, int picture, int w, int h, uint8_t *rle, int rle_len)
+static void write_image (sup_writer_t *sw, int timestamp, int dts, int picture, int w, int h, uint8_t *rle, int rle_len)
 {
 	sup_ods_first_t odsf;
 	sup_ods_next_t odsn = {picture, 0, 0};
@@ -371,7 +458,7 @@ static void write_image (FILE *fh, int timestamp, int dts, int picture, int w, i
 	}
 	rle_len -= size;
 
-	write_header(fh, timestamp, dts, 21, sizeof(odsf) + size);
+	write_header(sw, timestamp, dts, 21, sizeof(odsf) + size);
 
 	odsf.picture = picture;
 	odsf.m = 0;
@@ -380,8 +467,8 @@ static void write_image (FILE *fh, int timestamp, int dts, int picture, int w, i
 	odsf.height = h;
 
 	conv_sup_ods_first(&odsf);
-	fwrite(&odsf, sizeof(odsf), 1, fh);
-	fwrite(rle, size, 1, fh);
+	put(sw, &odsf, sizeof(odsf));
+	put_payload(sw, rle, size);
 	rle += size;
 
 	while (rle_len)
@@ -395,17 +482,17 @@ static void write_image (FILE *fh, int timestamp, int dts, int picture, int w, i
 		if (!rle_len)
 			odsn.last = 64;
 
-		write_header(fh, timestamp, dts, 21, sizeof(odsn) + size);
+		write_header(sw, timestamp, dts, 21, sizeof(odsn) + size);
 		conv_sup_ods_next(&odsn);
-		fwrite(&odsn, sizeof(odsn), 1, fh);
-		fwrite(rle, size, 1, fh);
+		put(sw, &odsn, sizeof(odsn));
+		put_payload(sw, rle, size);
 		rle += size;
 	}
 }
 
-static void write_marker (FILE *fh, int time)
+static void write_marker (sup_writer_t *sw, int time)
 {
-	write_header(fh, time, 0, 0x80, 0);
+	write_header(sw, time, 0, 0x80, 0);
 }
 
 typedef struct sup_pcs_end_s
@@ -425,11 +512,11 @@ void conv_sup_pcs_end (sup_pcs_end_t *pcse)
 	pcse->m = SWAP32(pcse->m);
 }
 
-static void write_pcs_end (FILE *fh, int end_time, int dts, int w, int h, int fps_id, int comp_num)
+static void write_pcs_end (sup_writer_t *sw, int end_time, int dts, int w, int h, int fps_id, int comp_num)
 {
 	sup_pcs_end_t pcse;
 
-	write_header(fh, end_time, dts, 22, sizeof(pcse));
+	write_header(sw, end_time, dts, 22, sizeof(pcse));
 
 	pcse.width = w;
 	pcse.height = h;
@@ -438,7 +525,7 @@ static void write_pcs_end (FILE *fh, int end_time, int dts, int w, int h, int fp
 	pcse.m = 0;
 
 	conv_sup_pcs_end(&pcse);
-	fwrite(&pcse, sizeof(pcse), 1, fh);
+	put(sw, &pcse, sizeof(pcse));
 }
 
 typedef struct fps_id_s
@@ -490,6 +577,7 @@ sup_writer_t *new_sup_writer (char *filename, int im_w, int im_h, int fps_num, i
 	sw->follower_end = -2;
 	sw->objects = 0;
 	sw->palettes = 0;
+	sw->display_sets = 0;
 	sw->buffer = 0;
 	sw->palette_offset = 0;
 	sw->picture_offset = 0;
@@ -497,6 +585,9 @@ sup_writer_t *new_sup_writer (char *filename, int im_w, int im_h, int fps_num, i
 	sw->last_window_ts = 0;
 	sw->window_num = 0;
 	sw->sil = si_list_new();
+	sw->buf = NULL;
+	sw->buf_len = 0;
+	sw->buf_size = 0;
 
 	memset(sw->windows, 0, 2 * sizeof(rect_t));
 
@@ -513,6 +604,20 @@ void destroy_si (subtitle_info_t *si)
 	free(si);
 }
 
+/* Find the window containing each crop */
+static void find_crop_windows (sup_writer_t *sw, int num_crop, rect_t *crops, int *in_window)
+{
+	int i, j;
+
+	for (i = 0; i < num_crop; i++)
+		for (j = 0; j < sw->window_num; j++)
+			if (crops[i].x >= sw->windows[j].x && crops[i].x + crops[i].w <= sw->windows[j].x + sw->windows[j].w && crops[i].y >= sw->windows[j].y && crops[i].y + crops[i].h <= sw->windows[j].y + sw->windows[j].h)
+			{
+				in_window[i] = j;
+				break;
+			}
+}
+
 void write_subtitle (sup_writer_t *sw, uint8_t **rle, int *rle_len, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int new_composition, int forced)
 {
 	uint32_t frame_ts, window_ts, decode_ts;
@@ -523,7 +628,7 @@ void write_subtitle (sup_writer_t *sw, uint8_t **rle, int *rle_len, int num_crop
 	uint32_t start_ts, end_ts, ts;
 	int follower = 0;
 	uint32_t im_ts = 0;
-	int i, j;
+	int i;
 	double tick_fac = 90000;
 
 	/* For stuff following frame by frame (endts = startts):
@@ -583,27 +688,21 @@ void write_subtitle (sup_writer_t *sw, uint8_t **rle, int *rle_len, int num_crop
 	}
 
 	/* Determine windows */
-	for (i = 0; i < num_crop; i++)
-		for (j = 0; j < sw->window_num; j++)
-			if (crops[i].x >= sw->windows[j].x && crops[i].x + crops[i].w <= sw->windows[j].x + sw->windows[j].w && crops[i].y >= sw->windows[j].y && crops[i].y + crops[i].h <= sw->windows[j].y + sw->windows[j].h)
-			{
-				in_window[i] = j;
-				break;
-			}
+	find_crop_windows(sw, num_crop, crops, in_window);
 
 	/* Write PCSS */
-	write_pcs_start(sw->fh, start_ts, dts, follower, num_crop, sw->im_w, sw->im_h, sw->fps_id, sw->comp_num);
+	write_pcs_start(sw, start_ts, dts, follower, num_crop, sw->im_w, sw->im_h, sw->fps_id, sw->comp_num, 0);
 	for (i = 0; i < num_crop; i++)
-		write_pcs_start_obj(sw->fh, sw->picture_offset + i, in_window[i], crops[i].x, crops[i].y, forced);
+		write_pcs_start_obj(sw, sw->picture_offset + i, in_window[i], crops[i].x, crops[i].y, forced);
 
 	/* Write WDS */
 	ts = start_ts - window_ts; /* Can be very slightly off, possible rounding error (FIXME: fixed?) */
-	write_wds(sw->fh, ts, dts, sw->window_num);
+	write_wds(sw, ts, dts, sw->window_num);
 	for (i = 0; i < sw->window_num; i++)
-		write_wds_obj(sw->fh, i, sw->windows[i].w, sw->windows[i].h, sw->windows[i].x, sw->windows[i].y);
+		write_wds_obj(sw, i, sw->windows[i].w, sw->windows[i].h, sw->windows[i].x, sw->windows[i].y);
 
 	/* Write palette */
-	write_palette(sw->fh, dts, sw->palette_offset, pal, sw->colorspace);
+	write_palette(sw, dts, sw->palette_offset, pal, sw->colorspace);
 
 	/* Write image data */
 	for (i = 0; i < num_crop; i++)
@@ -635,17 +734,42 @@ void write_subtitle (sup_writer_t *sw, uint8_t **rle, int *rle_len, int num_crop
 				dts = start_ts - later_window - decode_ts_list[1];
 			}
 		}
-		write_image(sw->fh, im_ts, dts, sw->picture_offset + i, crops[i].w, crops[i].h, rle[i], rle_len[i]);
+		write_image(sw, im_ts, dts, sw->picture_offset + i, crops[i].w, crops[i].h, rle[i], rle_len[i]);
 	}
 
 	/* Write marker */
-	write_marker(sw->fh, im_ts);
+	write_marker(sw, im_ts);
+	flush_sup(sw);
 
 	/* Remember data for creation of composition end */
 	sw->last_end_ts = end_ts;
 	sw->last_window_ts = window_ts;
 }
 
+/* Display set changing only the palette of the objects shown: PCSS, PAL, MARK */
+static void write_palette_update (sup_writer_t *sw, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int forced)
+{
+	uint32_t start_ts, end_ts;
+	int in_window[2];
+	int i;
+	double tick_fac = 90000;
+
+	tick_fac *= ((double)sw->fps_den) / ((double)sw->fps_num);
+	start_ts = (int)floor((double)start * tick_fac + 0.5);
+	end_ts = (int)floor((double)end * tick_fac + 0.5);
+	sw->follower_end = end;
+
+	find_crop_windows(sw, num_crop, crops, in_window);
+	write_pcs_start(sw, start_ts, start_ts, 1, num_crop, sw->im_w, sw->im_h, sw->fps_id, sw->comp_num, 1);
+	for (i = 0; i < num_crop; i++)
+		write_pcs_start_obj(sw, sw->picture_offset + i, in_window[i], crops[i].x, crops[i].y, forced);
+	write_palette(sw, start_ts, sw->palette_offset, pal, sw->colorspace);
+	write_marker(sw, start_ts);
+	flush_sup(sw);
+
+	sw->last_end_ts = end_ts;
+}
+
 void write_composition (sup_writer_t *sw)
 {
 	rect_t *rects;
@@ -653,6 +777,7 @@ void write_composition (sup_writer_t *sw)
 	int last_num_crop = 0;
 	rect_t last_crops[2];
 	int new_composition = 1;
+	int last_palette_only = 0;
 	int si_rects = 0;
 	int ts, dts;
 	int i;
@@ -693,13 +818,26 @@ void write_composition (sup_writer_t *sw)
 	si = si_list_first(sw->sil);
 	while (si != NULL)
 	{
-		if (!new_composition && (last_num_crop != si->num_crop || memcmp(last_crops, si->crops, MIN(last_num_crop, si->num_crop) * sizeof(rect_t))))
+		if (si->palette_only)
+		{
+			/* Same objects, new palette version */
+			(sw->comp_num)++;
+			(sw->palette_offset)++;
+			write_palette_update(sw, si->num_crop, si->crops, si->pal, si->start, si->end, si->forced);
+			last_palette_only = 1;
+			si_list_delete(sw->sil);
+			destroy_si(si);
+			si = si_list_get(sw->sil);
+			continue;
+		}
+		if (!new_composition && (last_palette_only || last_num_crop != si->num_crop || memcmp(last_crops, si->crops, MIN(last_num_crop, si->num_crop) * sizeof(rect_t))))
 		{
 			(sw->comp_num)++;
 			(sw->palette_offset)++;
 			(sw->picture_offset) += last_num_crop;
 		}
 		last_num_crop = si->num_crop;
+		last_palette_only = 0;
 		memcpy(last_crops, si->crops, si->num_crop * sizeof(rect_t));
 		write_subtitle(sw, si->rle, si->rle_len, si->num_crop, si->crops, si->pal, si->start, si->end, new_composition, si->forced);
 		new_composition = 0;
@@ -710,16 +848,17 @@ void write_composition (sup_writer_t *sw)
 
 	/* Write PCSE */
 	dts = sw->last_end_ts - sw->last_window_ts - 1;
-	write_pcs_end(sw->fh, sw->last_end_ts, dts, sw->im_w, sw->im_h, sw->fps_id, ++(sw->comp_num));
+	write_pcs_end(sw, sw->last_end_ts, dts, sw->im_w, sw->im_h, sw->fps_id, ++(sw->comp_num));
 
 	/* Write WDS */
 	ts = sw->last_end_ts - sw->last_window_ts;
-	write_wds(sw->fh, ts, dts, sw->window_num);
+	write_wds(sw, ts, dts, sw->window_num);
 	for (i = 0; i < sw->window_num; i++)
-		write_wds_obj(sw->fh, i, sw->windows[i].w, sw->windows[i].h, sw->windows[i].x, sw->windows[i].y);
+		write_wds_obj(sw, i, sw->windows[i].w, sw->windows[i].h, sw->windows[i].x, sw->windows[i].y);
 
 	/* Write marker */
-	write_marker(sw->fh, dts);
+	write_marker(sw, dts);
+	flush_sup(sw);
 
 	/* Cleanup */
 	free(rects);
@@ -730,12 +869,22 @@ void write_composition (sup_writer_t *sw)
 	/* Reset picture and palette count, new buffer. */
 	sw->objects = 0;
 	sw->palettes = 0;
+	sw->display_sets = 0;
 	sw->palette_offset = 0;
 	sw->picture_offset = 0;
 	sw->buffer = 0;
 }
 
-subtitle_info_t *collect_si (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int forced)
+static uint8_t *copy_rle (uint8_t *rle, int len)
+{
+	uint8_t *b = malloc(len);
+
+	memcpy(b, rle, len);
+
+	return b;
+}
+
+subtitle_info_t *collect_si (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int forced, sup_rle_t *reuse)
 {
 	subtitle_info_t *si = malloc(sizeof(subtitle_info_t));
 	int i;
@@ -749,14 +898,69 @@ subtitle_info_t *collect_si (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t
 		si->crops[i].h = crops[i].h;
 		si->crops[i].x = crops[i].x;
 		si->crops[i].y = crops[i].y;
-		si->rle[i] = rl_encode(im, sw->im_w, sw->im_h, si->crops[i], &(si->rle_len[i]));
+		if (reuse != NULL && reuse->valid)
+		{
+			si->rle_len[i] = reuse->rle_len[i];
+			si->rle[i] = copy_rle(reuse->rle[i], reuse->rle_len[i]);
+		}
+		else
+			si->rle[i] = rl_encode(im, sw->im_w, sw->im_h, si->crops[i], &(si->rle_len[i]));
 	}
 	memcpy(si->pal, pal, 256 * sizeof(uint32_t));
     si->forced = forced;
+	si->palette_only = 0;
+
+	/* Keep a copy of freshly encoded data */
+	if (reuse != NULL && !reuse->valid)
+	{
+		for (i = 0; i < num_crop; i++)
+		{
+			reuse->rle_len[i] = si->rle_len[i];
+			reuse->rle[i] = copy_rle(si->rle[i], si->rle_len[i]);
+		}
+		reuse->valid = 1;
+	}
 
 	return si;
 }
 
+/* Let's order them, so the one closer to 0/0 is the second. */
+static void order_crops (int num_crop, rect_t *crops)
+{
+	rect_t tmp;
+
+	if (num_crop > 1 && (crops[0].y < crops[1].y || (crops[0].y == crops[1].y && crops[0].x < crops[1].x)))
+	{
+		tmp = crops[0];
+		crops[0] = crops[1];
+		crops[1] = tmp;
+	}
+}
+
+void encode_sup_rle (sup_rle_t *r, uint8_t *im, int im_w, int im_h, int num_crop, rect_t *crops)
+{
+	rect_t c[2];
+	int i;
+
+	memcpy(c, crops, num_crop * sizeof(rect_t));
+	order_crops(num_crop, c);
+	for (i = 0; i < num_crop; i++)
+		r->rle[i] = rl_encode(im, im_w, im_h, c[i], &(r->rle_len[i]));
+	r->valid = 1;
+}
+
+void free_sup_rle (sup_rle_t *r)
+{
+	int i;
+
+	if (!r->valid)
+		return;
+	for (i = 0; i < 2; i++)
+		if (r->rle[i] != NULL)
+			free(r->rle[i]);
+	memset(r, 0, sizeof(sup_rle_t));
+}
+
 void close_sup_writer (sup_writer_t *sw)
 {
 	write_composition(sw);
@@ -770,22 +974,72 @@ void close_sup_writer (sup_writer_t *sw)
 	si_list_destroy(sw->sil);
 
 	fclose(sw->fh);
+	free(sw->buf);
 	free(sw);
 }
 
 IMPLEMENT_LIST(si, subtitle_info_t)
 
-void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int strict, int forced)
+/* Events repeating a palette of the current epoch do not use up another */
+static int find_palette (sup_writer_t *sw, uint32_t *pal)
+{
+	int i;
+
+	for (i = 0; i < MIN(sw->palettes, SUP_MAX_PALETTES); i++)
+		if (!memcmp(sw->epoch_pals[i], pal, 256 * sizeof(uint32_t)))
+			return i;
+
+	return -1;
+}
+
+static void add_palette (sup_writer_t *sw, uint32_t *pal)
+{
+	if (sw->palettes < SUP_MAX_PALETTES)
+		memcpy(sw->epoch_pals[sw->palettes], pal, 256 * sizeof(uint32_t));
+	(sw->palettes)++;
+}
+
+int write_sup_palette (sup_writer_t *sw, uint32_t *pal, int start, int end, int strict)
+{
+	subtitle_info_t *last, *si;
+	int new_palette;
+
+	if (!sw->non_new || start != sw->end || sw->display_sets >= SUP_MAX_DISPLAY_SETS || (last = si_list_last(sw->sil)) == NULL)
+		return 0;
+	new_palette = find_palette(sw, pal) < 0;
+	if (strict && sw->palettes + new_palette > SUP_MAX_PALETTES)
+		return 0;
+
+	si = calloc(1, sizeof(subtitle_info_t));
+	si->start = start;
+	si->end = end;
+	si->num_crop = last->num_crop;
+	memcpy(si->crops, last->crops, sizeof(si->crops));
+	memcpy(si->pal, pal, 256 * sizeof(uint32_t));
+	si->forced = last->forced;
+	si->palette_only = 1;
+
+	sw->end = end;
+	(sw->display_sets)++;
+	if (new_palette)
+		add_palette(sw, pal);
+	si_list_insert_after(sw->sil, si);
+
+	return 1;
+}
+
+void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int strict, int forced, sup_rle_t *reuse)
 {
-	rect_t tmp;
 	int buffer_increase;
+	int new_palette;
 	int i;
 
+	new_palette = find_palette(sw, pal) < 0;
 	buffer_increase = 0;
 	for (i = 0; i < num_crop; i++)
 		buffer_increase += crops[i].w * crops[i].h + 16;
 	/* Disabled some conditions for now. */
-	if (sw->non_new && ((start > sw->end + 1) || (sw->objects + num_crop > 64) || (strict && ((sw->buffer + buffer_increase >= 4 * 1024 * 1024) || (sw->palettes + 1 > 8)))))
+	if (sw->non_new && ((start > sw->end + 1) || (sw->objects + num_crop > 64) || (sw->display_sets >= SUP_MAX_DISPLAY_SETS) || (strict && ((sw->buffer + buffer_increase >= 4 * 1024 * 1024) || (sw->palettes + new_palette > SUP_MAX_PALETTES)))))
 	{
 #		if DEBUG != 0
 #		warning "DEBUG enabled."
@@ -807,31 +1061,25 @@ void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint
 			{
 				printf("Warning: Starting new epoch due to buffer overflow (%u -> %u > %u) for event starting at frame %u (including offsets) in stricter mode.\n", sw->buffer, sw->buffer + buffer_increase, 4 * 1024 * 1024, start);
 			}
-			else if (sw->palettes + 1 > 8)
+			else if (sw->palettes + new_palette > SUP_MAX_PALETTES)
 			{
 				printf("Warning: Starting new epoch due to too many palettes for event starting at frame %u (including offsets) in stricter mode.\n", start);
 			}
 		}
 #		endif
 		write_composition(sw);
+		new_palette = 1;
 	}
 	sw->non_new = 1;
 	sw->end = end;
 	sw->buffer += buffer_increase;
 	sw->objects += num_crop;
-	(sw->palettes)++; /* FIXME: It's probably okay not to increase this if the palette is identical to the last, but this would require further testing and possibly additional code so identical palettes are not written to the stream multiple times? */
+	(sw->display_sets)++;
+	if (new_palette)
+		add_palette(sw, pal);
 
-	if (num_crop > 1)
-	{
-		/* Let's order them, so the one closer to 0/0 is the second. */
-		if (crops[0].y < crops[1].y || (crops[0].y == crops[1].y && crops[0].x < crops[1].x))
-		{
-			tmp = crops[0];
-			crops[0] = crops[1];
-			crops[1] = tmp;
-		}
-	}
+	order_crops(num_crop, crops);
 
-	si_list_insert_after(sw->sil, collect_si(sw, im, num_crop, crops, pal, start, end, forced));
+	si_list_insert_after(sw->sil, collect_si(sw, im, num_crop, crops, pal, start, end, forced, reuse));
 }
 
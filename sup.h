@@ -32,10 +32,27 @@ typedef struct subtitle_info_s
 	uint8_t *rle[2];
 	uint32_t pal[256];
     int forced;
+	int palette_only; /* Only updates the palette of the previous objects */
 } subtitle_info_t;
 
 DECLARE_LIST(si, subtitle_info_t)
 
+/* Run-length encoded image data of a subtitle, kept for reuse. Filled on the
+ * first write_sup call it is passed to, copied from on later ones. */
+typedef struct sup_rle_s
+{
+	int valid;
+	int rle_len[2];
+	uint8_t *rle[2];
+} sup_rle_t;
+
+/* Palettes an epoch may hold in stricter mode */
+#define SUP_MAX_PALETTES 8
+
+/* Display sets per epoch. Each may take the next palette version, which
+ * has 8 bits, so the epoch ends before it would overflow. */
+#define SUP_MAX_DISPLAY_SETS 256
+
 typedef struct sup_writer_s
 {
 	FILE *fh;
@@ -52,6 +69,8 @@ typedef struct sup_writer_s
 	int buffer;
 	int objects;
 	int palettes;
+	int display_sets;
+	uint32_t epoch_pals[SUP_MAX_PALETTES][256];
 	int palette_offset;
 	int picture_offset;
 	int last_end_ts;
@@ -59,13 +78,29 @@ typedef struct sup_writer_s
 	int window_num;
 	rect_t windows[2];
 	si_list_t *sil;
+	uint8_t *buf; /* Display set being assembled */
+	int buf_len;
+	int buf_size;
 } sup_writer_t;
 
 /* Create a new sup writer state */
 sup_writer_t *new_sup_writer (char *filename, int im_w, int im_h, int fps_num, int fps_den);
 
-/* Write sup data for subtitle */
-void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int strict, int forced);
+/* Write sup data for subtitle. If reuse is not NULL and valid, its image data
+ * is used instead of encoding im. */
+void write_sup (sup_writer_t *sw, uint8_t *im, int num_crop, rect_t *crops, uint32_t *pal, int start, int end, int strict, int forced, sup_rle_t *reuse);
+
+/* Show the objects of the last subtitle with palette pal from start to end,
+ * without writing them again. It has to end at start. Returns 0 if this is
+ * not possible, then write_sup has to be used instead. */
+int write_sup_palette (sup_writer_t *sw, uint32_t *pal, int start, int end, int strict);
+
+/* Encode image data for im into r, in the order write_sup will use. Can be
+ * called from any thread. */
+void encode_sup_rle (sup_rle_t *r, uint8_t *im, int im_w, int im_h, int num_crop, rect_t *crops);
+
+/* Free image data held by r */
+void free_sup_rle (sup_rle_t *r);
 
 /* Call this once at the end */
 void close_sup_writer (sup_writer_t *sw);
@@ -0,0 +1,161 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#if defined(LINUX)
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+#include "worker_pool.h"
+
+static void *worker (void *arg)
+{
+	worker_pool_t *wp = arg;
+	work_t *w;
+
+	pthread_mutex_lock(&wp->lock);
+	for (;;)
+	{
+		while (wp->head == NULL && !wp->stop)
+			pthread_cond_wait(&wp->cond, &wp->lock);
+		if (wp->head == NULL)
+			break;
+		w = wp->head;
+		wp->head = w->next;
+		if (wp->head == NULL)
+			wp->tail = NULL;
+		pthread_mutex_unlock(&wp->lock);
+
+		w->func(w->arg);
+
+		pthread_mutex_lock(&wp->lock);
+		w->done = 1;
+		pthread_cond_broadcast(&wp->done_cond);
+	}
+	pthread_mutex_unlock(&wp->lock);
+
+	return NULL;
+}
+
+worker_pool_t *new_worker_pool (int n_threads)
+{
+	worker_pool_t *wp = calloc(1, sizeof(worker_pool_t));
+	int i;
+
+	pthread_mutex_init(&wp->lock, NULL);
+	pthread_cond_init(&wp->cond, NULL);
+	pthread_cond_init(&wp->done_cond, NULL);
+
+	wp->threads = calloc(n_threads + 1, sizeof(pthread_t));
+	for (i = 0; i < n_threads; i++)
+	{
+		if (pthread_create(&wp->threads[i], NULL, worker, wp))
+		{
+			fprintf(stderr, "Warning: Cannot start worker thread, using %d.\n", i);
+			break;
+		}
+	}
+	wp->n_threads = i;
+
+	return wp;
+}
+
+void worker_pool_submit (worker_pool_t *wp, work_t *w, work_func_t func, void *arg)
+{
+	w->func = func;
+	w->arg = arg;
+	w->done = 0;
+	w->next = NULL;
+
+	if (!wp->n_threads)
+	{
+		func(arg);
+		w->done = 1;
+		return;
+	}
+
+	pthread_mutex_lock(&wp->lock);
+	if (wp->tail != NULL)
+		wp->tail->next = w;
+	else
+		wp->head = w;
+	wp->tail = w;
+	pthread_cond_signal(&wp->cond);
+	pthread_mutex_unlock(&wp->lock);
+}
+
+int worker_pool_done (worker_pool_t *wp, work_t *w)
+{
+	int done;
+
+	if (!wp->n_threads)
+		return w->done;
+
+	pthread_mutex_lock(&wp->lock);
+	done = w->done;
+	pthread_mutex_unlock(&wp->lock);
+
+	return done;
+}
+
+void worker_pool_wait (worker_pool_t *wp, work_t *w)
+{
+	if (!wp->n_threads)
+		return;
+
+	pthread_mutex_lock(&wp->lock);
+	while (!w->done)
+		pthread_cond_wait(&wp->done_cond, &wp->lock);
+	pthread_mutex_unlock(&wp->lock);
+}
+
+void close_worker_pool (worker_pool_t *wp)
+{
+	int i;
+
+	pthread_mutex_lock(&wp->lock);
+	wp->stop = 1;
+	pthread_cond_broadcast(&wp->cond);
+	pthread_mutex_unlock(&wp->lock);
+	for (i = 0; i < wp->n_threads; i++)
+		pthread_join(wp->threads[i], NULL);
+
+	pthread_cond_destroy(&wp->done_cond);
+	pthread_cond_destroy(&wp->cond);
+	pthread_mutex_destroy(&wp->lock);
+	free(wp->threads);
+	free(wp);
+}
+
+int cpu_count ()
+{
+#if defined(LINUX)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n > 0 ? n : 1;
+#else
+	SYSTEM_INFO si;
+
+	GetSystemInfo(&si);
+
+	return si.dwNumberOfProcessors > 0 ? si.dwNumberOfProcessors : 1;
+#endif
+}
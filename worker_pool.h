@@ -0,0 +1,66 @@
+/*----------------------------------------------------------------------------
+ * avs2bdnxml - Generates BluRay subtitle stuff from RGBA AviSynth scripts
+ * Copyright (C) 2008-2013 Arne Bochem <avs2bdnxml at ps-auxw de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *----------------------------------------------------------------------------*/
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+
+typedef void (*work_func_t)(void *arg);
+
+/* A unit of work, usually embedded in the structure passed as arg */
+typedef struct work_s
+{
+	work_func_t func;
+	void *arg;
+	int done;
+	struct work_s *next;
+} work_t;
+
+typedef struct worker_pool_s
+{
+	int n_threads;
+	int stop;
+	work_t *head;  /* Queue of work not yet started */
+	work_t *tail;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;      /* Signals new work */
+	pthread_cond_t done_cond; /* Signals finished work */
+} worker_pool_t;
+
+/* Start n_threads worker threads. If n_threads is 0, work is run directly
+ * when submitted. */
+worker_pool_t *new_worker_pool (int n_threads);
+
+/* Queue w for running func(arg) */
+void worker_pool_submit (worker_pool_t *wp, work_t *w, work_func_t func, void *arg);
+
+/* Returns 1, if w has finished */
+int worker_pool_done (worker_pool_t *wp, work_t *w);
+
+/* Wait until w has finished */
+void worker_pool_wait (worker_pool_t *wp, work_t *w);
+
+/* Finish all queued work and stop the threads */
+void close_worker_pool (worker_pool_t *wp);
+
+/* Number of online CPUs, at least 1 */
+int cpu_count ();
+
+#endif